@@ -0,0 +1,135 @@
+#ifndef FIRMWARE_COMPONENTS_FASTMATH_INCLUDE_ANGLE_HPP
+#define FIRMWARE_COMPONENTS_FASTMATH_INCLUDE_ANGLE_HPP
+
+#include <cstdint>
+
+#include "FastMath.hpp"
+
+namespace fastMath {
+
+    /**
+     * @brief Orientation within one turn, stored as a 32 bit fixed-point fraction of a turn
+     *
+     * Adding and subtracting wrap for free through unsigned overflow and the shortest difference is a
+     * signed reinterpretation, so no wrapping helper, floor or double is needed. Conversions to and from
+     * radians or degrees are a single float multiply. Resolution is 2^-24 of a turn when built from a
+     * float, about 4e-7 radians, well below the 14 bit encoder.
+     */
+    class Angle {
+    public:
+        constexpr Angle() = default;
+
+        /**
+         * @brief Any number of turns, only the fraction is kept
+         * @note Turns must stay within the int32 range, which covers any encoder angle
+         */
+        static constexpr Angle fromTurns(const float turns) {
+            const float fraction = turns - static_cast<float>(static_cast<int32_t>(turns));
+            // fraction lies in (-1, 1), negative values wrap onto the turn through the unsigned conversion
+            return Angle(static_cast<uint32_t>(static_cast<int32_t>(fraction * m_fractionScale)) << m_fractionShift);
+        }
+
+        static constexpr Angle fromRadians(const float radians) { return fromTurns(radians * (1.0f / tau)); }
+        static constexpr Angle fromDegrees(const float degrees) { return fromTurns(degrees * (1.0f / 360.0f)); }
+
+        /**
+         * @brief Straight from the fixed-point representation, 2^32 is one turn
+         */
+        static constexpr Angle fromRaw(const uint32_t raw) { return Angle(raw); }
+
+        constexpr uint32_t raw() const { return m_raw; }
+
+        /**
+         * @brief Fraction of a turn in [0, 1)
+         */
+        constexpr float turns() const { return static_cast<float>(m_raw >> m_fractionShift) * (1.0f / m_fractionScale); }
+
+        /**
+         * @brief In [0, 2pi)
+         */
+        constexpr float radians() const { return static_cast<float>(m_raw >> m_fractionShift) * (tau / m_fractionScale); }
+
+        /**
+         * @brief In [0, 360)
+         */
+        constexpr float degrees() const { return static_cast<float>(m_raw >> m_fractionShift) * (360.0f / m_fractionScale); }
+
+        /**
+         * @brief In [-pi, pi)
+         */
+        constexpr float signedRadians() const { return signedFraction(m_raw) * (tau / m_fractionScale); }
+
+        /**
+         * @brief In [-180, 180)
+         */
+        constexpr float signedDegrees() const { return signedFraction(m_raw) * (360.0f / m_fractionScale); }
+
+        /**
+         * @brief Signed shortest rotation from this angle to other in radians, in [-pi, pi)
+         */
+        constexpr float radiansTo(const Angle other) const { return (other - *this).signedRadians(); }
+
+        /**
+         * @brief Signed shortest rotation from this angle to other in degrees, in [-180, 180)
+         */
+        constexpr float degreesTo(const Angle other) const { return (other - *this).signedDegrees(); }
+
+        /**
+         * @brief Sine and cosine, the quadrant comes straight from the top bits so range reduction is exact
+         */
+        constexpr SinCos sincos() const {
+            // Round to the nearest quadrant, leaving a remainder within an eighth of a turn
+            const uint32_t quadrant = (m_raw + (1u << 29)) >> 30;
+            const float    r        = signedFraction(m_raw - (quadrant << 30)) * (tau / m_fractionScale);
+            const float    s        = detail::sinPoly(r);
+            const float    c        = detail::cosPoly(r);
+            switch (quadrant & 3) {
+                case 0: return {s, c};
+                case 1: return {c, -s};
+                case 2: return {-s, -c};
+                default: return {-c, s};
+            }
+        }
+
+        /**
+         * @brief Table based sine, for visuals where ~1e-4 error is invisible
+         */
+        constexpr float tableSin() const { return detail::tableLookup(turns()); }
+
+        constexpr Angle operator+(const Angle other) const { return Angle(m_raw + other.m_raw); }
+        constexpr Angle operator-(const Angle other) const { return Angle(m_raw - other.m_raw); }
+        constexpr Angle operator-() const { return Angle(0u - m_raw); }
+
+        constexpr Angle& operator+=(const Angle other) {
+            m_raw += other.m_raw;
+            return *this;
+        }
+
+        constexpr Angle& operator-=(const Angle other) {
+            m_raw -= other.m_raw;
+            return *this;
+        }
+
+        constexpr bool operator==(const Angle other) const { return m_raw == other.m_raw; }
+        constexpr bool operator!=(const Angle other) const { return m_raw != other.m_raw; }
+
+    private:
+        // Floats carry 24 significant bits, conversions go through the top 24 bits of the fraction
+        static constexpr uint32_t m_fractionShift = 8;
+        static constexpr float    m_fractionScale = 16777216.0f; // 2^24
+
+        uint32_t m_raw = 0;
+
+        explicit constexpr Angle(const uint32_t raw) : m_raw(raw) {}
+
+        static constexpr float signedFraction(const uint32_t raw) {
+            return static_cast<float>(static_cast<int32_t>(raw) >> m_fractionShift);
+        }
+    };
+
+    static constexpr Angle quarterTurn = Angle::fromRaw(1u << 30);
+    static constexpr Angle halfTurn    = Angle::fromRaw(1u << 31);
+
+} // namespace fastMath
+
+#endif // FIRMWARE_COMPONENTS_FASTMATH_INCLUDE_ANGLE_HPP
@@ -0,0 +1,220 @@
+#ifndef FIRMWARE_COMPONENTS_FASTMATH_INCLUDE_FASTMATH_HPP
+#define FIRMWARE_COMPONENTS_FASTMATH_INCLUDE_FASTMATH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "sdkconfig.h"
+
+/**
+ * @brief Single precision trig and angle helpers for code that runs per sample or per LED
+ *
+ * Two flavours of sin/cos are provided:
+ *  - sin(), cos(), sincos(): Cody-Waite range reduction plus a minimax polynomial, ~1e-7 error
+ *  - tableSin(), tableCos(): linear interpolation in a 256 entry table, ~1e-4 error, cheapest
+ *
+ * Everything is constexpr and avoids libm, so tables and constants can be built at compile time.
+ * Inputs are assumed to be within a few million radians of zero, beyond that the range reduction
+ * loses precision.
+ */
+namespace fastMath {
+
+    static constexpr float pi        = 3.14159265358979323846f;
+    static constexpr float tau       = 2.0f * pi;
+    static constexpr float halfPi    = 0.5f * pi;
+    static constexpr float quarterPi = 0.25f * pi;
+
+    static constexpr float degreesToRadians = pi / 180.0f;
+    static constexpr float radiansToDegrees = 180.0f / pi;
+
+    struct SinCos {
+        float sin;
+        float cos;
+    };
+
+    constexpr float abs(const float x) {
+        return x < 0.0f ? -x : x;
+    }
+
+    constexpr float floor(const float x) {
+        const auto truncated = static_cast<float>(static_cast<int64_t>(x));
+        return truncated > x ? truncated - 1.0f : truncated;
+    }
+
+    /**
+     * @brief Wraps an angle in radians to [0, 2pi)
+     */
+    constexpr float wrapTwoPi(const float radians) {
+        const float wrapped = radians - tau * floor(radians * (1.0f / tau));
+        // Rounding of the quotient can push the result just outside the range on either side
+        if (wrapped < 0.0f) {
+            return wrapped + tau >= tau ? 0.0f : wrapped + tau;
+        }
+        return wrapped >= tau ? 0.0f : wrapped;
+    }
+
+    /**
+     * @brief Wraps an angle in radians to [-pi, pi)
+     */
+    constexpr float wrapPi(const float radians) {
+        return wrapTwoPi(radians + pi) - pi;
+    }
+
+    /**
+     * @brief Wraps an angle in degrees to [0, 360)
+     */
+    constexpr float wrapDegrees(const float degrees) {
+        const float wrapped = degrees - 360.0f * floor(degrees * (1.0f / 360.0f));
+        if (wrapped < 0.0f) {
+            return wrapped + 360.0f >= 360.0f ? 0.0f : wrapped + 360.0f;
+        }
+        return wrapped >= 360.0f ? 0.0f : wrapped;
+    }
+
+    /**
+     * @brief Signed shortest rotation from a to b in radians, in [-pi, pi)
+     */
+    constexpr float shortestDifference(const float a, const float b) {
+        return wrapPi(b - a);
+    }
+
+    /**
+     * @brief Signed shortest rotation from a to b in degrees, in [-180, 180)
+     */
+    constexpr float shortestDegreeDifference(const float a, const float b) {
+        return wrapDegrees(b - a + 180.0f) - 180.0f;
+    }
+
+    namespace detail {
+        // Cephes sinf/cosf coefficients, valid on [-pi/4, pi/4]
+        constexpr float sinPoly(const float x) {
+            const float z = x * x;
+            return x + x * z * (-1.6666654611e-1f + z * (8.3321608736e-3f + z * -1.9515295891e-4f));
+        }
+
+        constexpr float cosPoly(const float x) {
+            const float z = x * x;
+            return 1.0f - 0.5f * z + z * z * (4.166664568298827e-2f + z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+        }
+
+        struct Reduced {
+            float   remainder;
+            int32_t quadrant;
+        };
+
+        // Splits x into quadrant * pi/2 + remainder with remainder in [-pi/4, pi/4]. pi/2 is split
+        // in three parts with few significant bits each, so the products with quadrant stay exact.
+        constexpr Reduced reduce(const float x) {
+            constexpr float halfPiHigh = 1.5703125f;
+            constexpr float halfPiMid  = 4.837512969970703125e-4f;
+            constexpr float halfPiLow  = 7.54978995489188216e-8f;
+
+            const float scaled   = x * (2.0f / pi);
+            const auto  quadrant = static_cast<int32_t>(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+            const auto  q        = static_cast<float>(quadrant);
+            return {((x - q * halfPiHigh) - q * halfPiMid) - q * halfPiLow, quadrant};
+        }
+
+        constexpr size_t tableSize = 256;
+
+        constexpr std::array<float, tableSize + 1> sinTable = [] {
+            std::array<float, tableSize + 1> table{};
+            for (size_t i = 0; i <= tableSize; i++) {
+                const auto [r, quadrant] = reduce(tau * static_cast<float>(i) / tableSize);
+                switch (quadrant & 3) {
+                    case 0: table[i] = sinPoly(r); break;
+                    case 1: table[i] = cosPoly(r); break;
+                    case 2: table[i] = -sinPoly(r); break;
+                    default: table[i] = -cosPoly(r); break;
+                }
+            }
+            return table;
+        }();
+
+        constexpr float tableLookup(const float turns) {
+            const float    position = (turns - floor(turns)) * tableSize;
+            const auto     index    = static_cast<uint32_t>(position);
+            const float    frac     = position - static_cast<float>(index);
+            const uint32_t wrapped  = index & (tableSize - 1);
+            return sinTable[wrapped] + frac * (sinTable[wrapped + 1] - sinTable[wrapped]);
+        }
+    } // namespace detail
+
+    /**
+     * @brief Sine and cosine of the same angle, sharing one range reduction
+     */
+    constexpr SinCos sincos(const float radians) {
+        const auto [r, quadrant] = detail::reduce(radians);
+        const float s            = detail::sinPoly(r);
+        const float c            = detail::cosPoly(r);
+        switch (quadrant & 3) {
+            case 0: return {s, c};
+            case 1: return {c, -s};
+            case 2: return {-s, -c};
+            default: return {-c, s};
+        }
+    }
+
+    constexpr float sin(const float radians) {
+        return sincos(radians).sin;
+    }
+
+    constexpr float cos(const float radians) {
+        return sincos(radians).cos;
+    }
+
+    /**
+     * @brief Table based sine, for visuals where ~1e-4 error is invisible
+     */
+    constexpr float tableSin(const float radians) {
+        return detail::tableLookup(radians * (1.0f / tau));
+    }
+
+    constexpr float tableCos(const float radians) {
+        return detail::tableLookup(radians * (1.0f / tau) + 0.25f);
+    }
+
+    /**
+     * @brief Four quadrant arctangent, ~3e-7 rad error
+     * @return Angle in [-pi, pi], 0 when both arguments are 0
+     */
+    constexpr float atan2(const float y, const float x) {
+        const float ax = abs(x);
+        const float ay = abs(y);
+        if (ax == 0.0f && ay == 0.0f) {
+            return 0.0f;
+        }
+
+        // Reduce to a ratio in [0, 1], then around tan(pi/8) so the polynomial stays accurate
+        const bool swapped = ay > ax;
+        float      t       = swapped ? ax / ay : ay / ax;
+        float      offset  = 0.0f;
+        if (t > 0.4142135623730950f) {
+            t      = (t - 1.0f) / (t + 1.0f);
+            offset = quarterPi;
+        }
+
+        // Cephes atanf polynomial
+        const float z     = t * t;
+        float       angle = offset + t + t * z * (((8.05374449538e-2f * z - 1.38776856032e-1f) * z + 1.99777106478e-1f) * z - 3.33329491539e-1f);
+
+        if (swapped) {
+            angle = halfPi - angle;
+        }
+        if (x < 0.0f) {
+            angle = pi - angle;
+        }
+        return y < 0.0f ? -angle : angle;
+    }
+
+#ifdef CONFIG_FASTMATH_BENCHMARK
+    /**
+     * @brief Logs maximum error and time per call of every function against libm
+     */
+    void benchmark();
+#endif
+
+} // namespace fastMath
+
+#endif // FIRMWARE_COMPONENTS_FASTMATH_INCLUDE_FASTMATH_HPP
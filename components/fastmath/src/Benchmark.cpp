@@ -0,0 +1,136 @@
+#include "FastMath.hpp"
+
+#ifdef CONFIG_FASTMATH_BENCHMARK
+
+#include <cmath>
+
+#include "Angle.hpp"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char TAG[] = "fastMath";
+
+namespace fastMath {
+
+    namespace {
+        constexpr int   iterations = 10000;
+        // Covers a few turns either way, like unwrapped encoder angles do
+        constexpr float rangeStart = -4.0f * tau;
+        constexpr float rangeStep  = 8.0f * tau / iterations;
+
+        // Keeps the compiler from dropping calls whose result is unused
+        volatile float sink;
+
+        template<typename F>
+        float timeUs(F&& f) {
+            const int64_t start = esp_timer_get_time();
+            for (int i = 0; i < iterations; i++) {
+                sink = f(rangeStart + static_cast<float>(i) * rangeStep);
+            }
+            return static_cast<float>(esp_timer_get_time() - start) * 1000.0f / iterations;
+        }
+
+        template<typename F, typename R>
+        float maxError(F&& f, R&& reference) {
+            float error = 0.0f;
+            for (int i = 0; i < iterations; i++) {
+                const float x = rangeStart + static_cast<float>(i) * rangeStep;
+                error         = std::fmax(error, std::fabs(f(x) - static_cast<float>(reference(static_cast<double>(x)))));
+            }
+            return error;
+        }
+
+        template<typename F, typename L, typename R>
+        void report(const char* name, F&& fast, L&& libm, R&& reference) {
+            ESP_LOGI(TAG, "%-9s max error %.2e, %6.1f ns/call (libm %.2e, %6.1f ns/call)", name,
+                     maxError(fast, reference), timeUs(fast), maxError(libm, reference), timeUs(libm));
+        }
+
+        // Includes the loop and the float input, which both sides share, so the difference is what a call site saves
+        template<typename F>
+        float timeCycles(F&& f) {
+            const uint32_t start = esp_cpu_get_cycle_count();
+            for (int i = 0; i < iterations; i++) {
+                sink = f(rangeStart + static_cast<float>(i) * rangeStep);
+            }
+            return static_cast<float>(esp_cpu_get_cycle_count() - start) / iterations;
+        }
+
+        template<typename B, typename A>
+        void reportCallSite(const char* name, B&& before, A&& after) {
+            const float beforeCycles = timeCycles(before);
+            const float afterCycles  = timeCycles(after);
+            ESP_LOGI(TAG, "%-15s %6.1f -> %6.1f cycles/call, %6.1f saved", name, beforeCycles, afterCycles, beforeCycles - afterCycles);
+        }
+
+        /**
+         * @brief Angle call sites as they were with double, next to their Angle replacement
+         */
+        void benchmarkAngle() {
+            // Default ring size
+            constexpr int leds = 64;
+
+            // MagneticEncoder::getDegrees()
+            reportCallSite("encoder degrees",
+                           [](float x) { return static_cast<float>(x * (180.0 / M_PI) * -1.0l); },
+                           [](float x) { return (-Angle::fromRadians(x)).degrees(); });
+            // Ring light pointer effect, distance of one LED to the pointer
+            reportCallSite("ring pointer",
+                           [](float x) {
+                               const double paramA = x * -fastMath::radiansToDegrees;
+                               const float  led    = static_cast<float>(7) * static_cast<float>(360.0 / leds);
+                               return abs(shortestDegreeDifference(wrapDegrees(static_cast<float>(paramA)), led));
+                           },
+                           [](float x) {
+                               const Angle paramA = -Angle::fromRadians(x);
+                               return abs(paramA.degreesTo(Angle::fromTurns(7.0f / leds)));
+                           });
+            // Ring light gradient effect, height of one LED
+            reportCallSite("ring gradient",
+                           [](float x) {
+                               const double paramA = x * -fastMath::radiansToDegrees;
+                               const float  angle  = wrapDegrees(static_cast<float>(paramA)) * degreesToRadians;
+                               return tableSin(halfPi + static_cast<float>(7) * static_cast<float>(2 * M_PI / leds) - angle);
+                           },
+                           [](float x) {
+                               const Angle paramA = -Angle::fromRadians(x);
+                               return (quarterTurn + Angle::fromTurns(7.0f / leds) - paramA).tableSin();
+                           });
+            // Position of the dot on the screen
+            reportCallSite("ui dot",
+                           [](float x) {
+                               const double radians = -static_cast<double>(x) - M_PI_2;
+                               return static_cast<float>(std::sin(radians) + std::cos(radians));
+                           },
+                           [](float x) {
+                               const auto [s, c] = (-Angle::fromRadians(x) - quarterTurn).sincos();
+                               return s + c;
+                           });
+        }
+    } // namespace
+
+    void benchmark() {
+        const auto refSin = [](double x) { return std::sin(x); };
+        const auto refCos = [](double x) { return std::cos(x); };
+
+        report("sin", [](float x) { return sin(x); }, [](float x) { return std::sin(x); }, refSin);
+        report("cos", [](float x) { return cos(x); }, [](float x) { return std::cos(x); }, refCos);
+        report("tableSin", [](float x) { return tableSin(x); }, [](float x) { return std::sin(x); }, refSin);
+        report("tableCos", [](float x) { return tableCos(x); }, [](float x) { return std::cos(x); }, refCos);
+        report("sincos",
+               [](float x) { const auto [s, c] = sincos(x); return s + c; },
+               [](float x) { return std::sin(x) + std::cos(x); },
+               [](double x) { return std::sin(x) + std::cos(x); });
+        // x is used as both coordinates with different scales, so every octant and branch is exercised
+        report("atan2",
+               [](float x) { return atan2(3.0f * x, 2.0f - x); },
+               [](float x) { return std::atan2(3.0f * x, 2.0f - x); },
+               [](double x) { return std::atan2(3.0 * x, 2.0 - x); });
+
+        benchmarkAngle();
+    }
+
+} // namespace fastMath
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef FIRMWARE_COMPONENTS_HISTORY_BUFFER_INCLUDE_HISTORYBUFFER_HPP
+#define FIRMWARE_COMPONENTS_HISTORY_BUFFER_INCLUDE_HISTORYBUFFER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+/**
+ * @brief Single writer, multiple reader ring buffer of the most recent values
+ *
+ * The writer never waits and readers never block it. Readers either run a query against the buffer in
+ * place, which only retries when the writer overwrote one of the values the query looked at meanwhile,
+ * or consume it through their own cursor, so several consumers can each see every value. A consumer that
+ * falls more than N - 1 values behind skips the ones the writer overwrote.
+ *
+ * @tparam T Trivially copyable value to keep
+ * @tparam N Number of values kept, a power of two
+ */
+template<typename T, size_t N>
+class HistoryBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "HistoryBuffer values are copied while being written");
+    static_assert(std::has_single_bit(N), "HistoryBuffer length must be a power of two");
+
+public:
+    /**
+     * @brief Newest first view of the buffer, handed to queries. Holds at most N - 1 values, the slot
+     *        of the oldest may be half written by the next push.
+     */
+    class View {
+    public:
+        size_t size() const { return m_size; }
+
+        /**
+         * @param age 0 is the newest value, size() - 1 the oldest
+         */
+        T operator[](const size_t age) const {
+            m_depth = std::max(m_depth, age + 1);
+            return m_buffer.m_values[(m_count - 1 - age) & (N - 1)];
+        }
+
+    private:
+        friend class HistoryBuffer;
+
+        View(const HistoryBuffer& buffer, const uint32_t count) :
+            m_buffer(buffer), m_count(count), m_size(std::min<size_t>(count, N - 1)) {}
+
+        const HistoryBuffer& m_buffer;
+        uint32_t             m_count;
+        size_t               m_size;
+        mutable size_t       m_depth = 0;
+    };
+
+    /**
+     * @brief Adds a value, overwriting the oldest once full, only one task may write
+     */
+    void push(const T& value) {
+        const uint32_t count = m_count.load(std::memory_order_relaxed);
+        m_values[count & (N - 1)] = value;
+        m_count.store(count + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Number of values pushed so far, a cursor starting here only sees values pushed after this call
+     */
+    uint32_t count() const { return m_count.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Runs a query on the buffer, safe to call from any task
+     * @param query Called with a View, may be called again if the writer overwrote a value it read
+     * @return Whatever the query returned on its last, consistent, run
+     */
+    template<typename Query>
+    auto read(Query&& query) const {
+        for (;;) {
+            const uint32_t count = m_count.load(std::memory_order_acquire);
+            const View     view(*this, count);
+            auto           result = query(view);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (intact(count - static_cast<uint32_t>(view.m_depth))) {
+                return result;
+            }
+        }
+    }
+
+    /**
+     * @brief Newest value, safe to call from any task
+     * @return std::nullopt when nothing was pushed yet
+     */
+    std::optional<T> latest() const {
+        return read([](const View& view) -> std::optional<T> {
+            if (view.size() == 0) {
+                return std::nullopt;
+            }
+            return view[0];
+        });
+    }
+
+    /**
+     * @brief Hands every value pushed since cursor to f, oldest first, and moves cursor past them
+     * @param cursor Owned by one reader, start it at 0 or count()
+     * @return Number of values handed to f
+     */
+    template<typename F>
+    size_t consume(uint32_t& cursor, F&& f) const {
+        const uint32_t count = m_count.load(std::memory_order_acquire);
+        if (count - cursor > N - 1) {
+            cursor = count - (N - 1);
+        }
+
+        size_t consumed = 0;
+        for (; cursor != count; cursor++) {
+            const T value = m_values[cursor & (N - 1)];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (intact(cursor)) {
+                f(value);
+                consumed++;
+            }
+        }
+        return consumed;
+    }
+
+private:
+    std::atomic<uint32_t> m_count{0};
+    std::array<T, N>      m_values{};
+
+    // The writer's next value overwrites index `now - N`, every index above that is intact
+    bool intact(const uint32_t index) const {
+        return m_count.load(std::memory_order_relaxed) - index < N;
+    }
+};
+
+#endif // FIRMWARE_COMPONENTS_HISTORY_BUFFER_INCLUDE_HISTORYBUFFER_HPP
@@ -0,0 +1,93 @@
+#ifndef FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_ENCODERLINEARITY_HPP
+#define FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_ENCODERLINEARITY_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include "Mt6701Frame.hpp"
+
+/**
+ * @brief Compensates the periodic angle error an off-center magnet causes in the MT6701
+ *
+ * The error over one revolution is stored as a small table of signed counts, correct()
+ * interpolates it with integer math only so it can run on every sample in the FOC loop.
+ */
+class EncoderLinearity {
+public:
+    static constexpr size_t tableSize = 64;
+    using Table                       = std::array<int16_t, tableSize>;
+
+    /**
+     * @brief Streaming harmonic fit of the angle error, O(1) memory regardless of the number of samples
+     */
+    class Fit {
+    public:
+        /**
+         * @brief Adds a measurement, samples should cover the revolution uniformly
+         * @param count Raw single-turn encoder count
+         * @param errorCounts Measured minus commanded angle, in counts
+         */
+        void addSample(uint16_t count, float errorCounts);
+
+        /**
+         * @brief Samples the fitted harmonics into a correction table, the mean offset is left out
+         */
+        Table table() const;
+
+        uint32_t samples() const { return m_samples; }
+
+    private:
+        // Magnet eccentricity and tilt show up in the first few harmonics, higher ones are mostly noise
+        static constexpr size_t m_harmonics = 4;
+
+        std::array<float, m_harmonics> m_cos{};
+        std::array<float, m_harmonics> m_sin{};
+        uint32_t                       m_samples = 0;
+    };
+
+    /**
+     * @brief Builds a new correction table and activates it with a single pointer store
+     *
+     * The sampler keeps reading whichever table it loaded the pointer of, so the table this one
+     * replaces is only freed by the load after it, like the haptic profile swap.
+     *
+     * @note Called by one task at a time
+     */
+    void load(const Table& table);
+    void clear() { m_current.store(nullptr, std::memory_order_release); }
+    bool isActive() const { return m_current.load(std::memory_order_acquire) != nullptr; }
+
+    /**
+     * @brief Removes the calibrated error from a raw count, a couple dozen cycles at most
+     * @return std::nullopt while no table is active
+     */
+    std::optional<uint16_t> correct(const uint16_t count) const {
+        const Interpolation* table = m_current.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            return std::nullopt;
+        }
+
+        const uint32_t index = count >> m_binShift;
+        const int32_t  frac  = count & ((1 << m_binShift) - 1);
+        const int32_t  a     = (*table)[index];
+        const int32_t  b     = (*table)[index + 1];
+        const int32_t  error = a + (((b - a) * frac) >> m_binShift);
+        return static_cast<uint16_t>((count - error) & (mt6701Frame::countsPerRevolution - 1));
+    }
+
+private:
+    static constexpr uint32_t m_binShift = 8;
+    static_assert((tableSize << m_binShift) == mt6701Frame::countsPerRevolution, "Table must cover exactly one revolution");
+
+    // One extra entry repeats the first, so interpolation never has to wrap the index
+    using Interpolation = std::array<int16_t, tableSize + 1>;
+
+    std::atomic<const Interpolation*> m_current{nullptr};
+    std::unique_ptr<Interpolation>    m_owned;
+    std::unique_ptr<Interpolation>    m_previous;
+};
+
+#endif // FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_ENCODERLINEARITY_HPP
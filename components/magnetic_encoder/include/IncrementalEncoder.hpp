@@ -0,0 +1,92 @@
+#ifndef FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_INCREMENTALENCODER_HPP
+#define FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_INCREMENTALENCODER_HPP
+
+#include <driver/pulse_cnt.h>
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <system_error>
+
+#include "Mt6701Frame.hpp"
+#include "sdkconfig.h"
+
+/**
+ * @brief Counts the MT6701 A/B quadrature outputs with the PCNT peripheral and maps them onto the SSI angle
+ *
+ * The PCNT unit counts every edge of both channels in hardware, so reading the position costs one register
+ * read instead of an SSI transaction. The unit's limits are one revolution of quadrature counts, it wraps to
+ * 0 at either limit, which keeps the count a plain single-turn position. Every few samples an absolute SSI
+ * read re-anchors the count, which also makes up for edges lost to noise.
+ *
+ * Only used by the sampler, other tasks may read stats().
+ */
+class IncrementalEncoder {
+public:
+    static constexpr int      pulsesPerRevolution = CONFIG_MAGNETIC_ENCODER_ABZ_RESOLUTION;
+    static constexpr int      countsPerRevolution = 4 * pulsesPerRevolution;
+    static constexpr uint32_t resyncInterval      = CONFIG_MAGNETIC_ENCODER_SSI_RESYNC_INTERVAL;
+    static_assert(std::has_single_bit(static_cast<uint32_t>(pulsesPerRevolution)), "ABZ resolution must be a power of two");
+
+    struct Stats {
+        uint32_t resyncs;        ///< SSI reads the count was re-anchored on
+        uint32_t skippedResyncs; ///< SSI reads during which an edge came in, retried on the next sample
+        uint32_t lastError;      ///< Count drift found by the last resync, in SSI counts
+        uint32_t maxError;       ///< Largest drift found by a resync, in SSI counts
+    };
+
+    /**
+     * @brief Sets up the PCNT unit and its two channels and starts counting
+     * @return esp_err_t on error
+     */
+    std::error_code initialize();
+    void            stop();
+
+    /**
+     * @brief Whether the next sample has to be an SSI read, true until the first resync
+     */
+    bool resyncDue() const { return !m_synced || m_samplesSinceResync >= resyncInterval; }
+
+    /**
+     * @brief Raw PCNT count, in (-countsPerRevolution, countsPerRevolution)
+     */
+    int pulses() const;
+
+    /**
+     * @brief Single-turn angle in SSI counts from the PCNT count
+     */
+    uint16_t count();
+
+    /**
+     * @brief Re-anchors the count on an absolute SSI read
+     * @param ssiCount Count decoded from the SSI frame
+     * @param pulsesBefore pulses() right before the SSI read, the resync is skipped when an edge came in
+     *                     during the read, as it is unknown which side of the edge the SSI angle is on
+     */
+    void resync(uint16_t ssiCount, int pulsesBefore);
+
+    Stats stats() const {
+        return {m_resyncs.load(std::memory_order_relaxed), m_skippedResyncs.load(std::memory_order_relaxed),
+                m_lastError.load(std::memory_order_relaxed), m_maxError.load(std::memory_order_relaxed)};
+    }
+
+private:
+    static constexpr uint16_t m_countsPerPulse = mt6701Frame::countsPerRevolution / countsPerRevolution;
+    // Shorter pulses are noise, edges at full speed are still tens of microseconds apart
+    static constexpr uint32_t m_glitchFilterNs = 1000;
+
+    pcnt_unit_handle_t    m_unit     = nullptr;
+    pcnt_channel_handle_t m_channelA = nullptr;
+    pcnt_channel_handle_t m_channelB = nullptr;
+
+    bool     m_synced             = false;
+    uint16_t m_offset             = 0;
+    uint32_t m_samplesSinceResync = 0;
+
+    std::atomic<uint32_t> m_resyncs{0};
+    std::atomic<uint32_t> m_skippedResyncs{0};
+    std::atomic<uint32_t> m_lastError{0};
+    std::atomic<uint32_t> m_maxError{0};
+};
+
+#endif // FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_INCREMENTALENCODER_HPP
@@ -5,23 +5,83 @@
 #ifndef FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_MAGNETICENCODER_HPP
 #define FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_MAGNETICENCODER_HPP
 
+#include "Angle.hpp"
 #include "Component.hpp"
+#include "ConfigProvider.hpp"
+#include "EncoderLinearity.hpp"
+#include "HistoryBuffer.hpp"
+#include "SeqLock.hpp"
+#include "VelocityObserver.hpp"
 #include "butterworth_filter.hpp"
 
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+#include "IncrementalEncoder.hpp"
+#endif
+
 #include <mt6701.hpp>
 #include <driver/spi_master.h>
 
+#include <atomic>
+#include <memory>
+#include <optional>
+
 using Mt6701_spi = espp::Mt6701<espp::Mt6701Interface::SSI>;
 using ButterFilter = espp::ButterworthFilter<2, espp::BiquadFilterDf2>;
 
 class MagneticEncoder final : public sdk::Component {
 public:
-	MagneticEncoder() :
-		m_filter({.normalized_cutoff_frequency = 2.0f * m_filterCutoffHz * m_encoderUpdatePeriod}) {
+	class Config final : public sdk::ConfigObject<1, 768, "Magnetic encoder"> {
+		using Base = ConfigObject;
+
+	public:
+		sdk::ConfigField<EncoderLinearity::Table> linearityTable{{}, "linearityTable"};
+
+		void allocateFields() {
+			linearityTable = allocate(linearityTable);
+		}
+
+		explicit Config(const nlohmann::json& data) : Base(data) {
+			allocateFields();
+		}
+
+		Config() {
+			allocateFields();
+		}
+
+		void updateField(const sdk::ConfigField<EncoderLinearity::Table>& field, const EncoderLinearity::Table& newValue) { Base::updateField(field, newValue); }
+	};
+
+	/**
+	 * @brief Encoder state published once per sample
+	 */
+	struct Snapshot {
+		float    radians;   ///< Multi-turn shaft angle
+		float    velocity;  ///< Estimated shaft velocity in radians per second
+		int64_t  timestamp; ///< esp_timer time the encoder was read, in microseconds
+		uint32_t sequence;  ///< Number of samples taken, increments by one per sample
+
+		/**
+		 * @brief Shaft orientation within one turn, counter-clockwise positive
+		 */
+		fastMath::Angle angle() const { return fastMath::Angle::fromRadians(radians); }
+	};
 
+	/**
+	 * @brief Entry of the angle history, one per history interval
+	 */
+	struct HistorySample {
+		float    radians;      ///< Multi-turn shaft angle at the end of the interval
+		float    peakVelocity; ///< Velocity of largest magnitude within the interval, radians per second
+		int64_t  timestamp;    ///< esp_timer time of the last sample in the interval, in microseconds
+	};
+
+	MagneticEncoder() {
+
+		// Mt6701 stores these as std::function, single pointer captures fit its small buffer
+		// so unlike std::bind they never allocate and call straight into the member function
 		m_dev = std::make_shared<Mt6701_spi>(Mt6701_spi::Config{
-			.read = std::bind(&MagneticEncoder::read, this, std::placeholders::_1, std::placeholders::_2),
-			.velocity_filter = std::bind(&MagneticEncoder::m_filterFn, this, std::placeholders::_1),
+			.read = [this](uint8_t* data, size_t len) { return read(data, len); },
+			.velocity_filter = [this](float rawRpm) { return estimateVelocity(rawRpm); },
 			.auto_init = false,
 			.run_task = false,
 			.log_level = espp::Logger::Verbosity::NONE
@@ -36,14 +96,94 @@ public:
 	Status run() override;
 	Status stop() override;
 
-	std::expected<double, std::error_code> getDegrees() const;
-	std::expected<double, std::error_code> getRadians() const;
+	/**
+	 * @brief Shaft orientation within one turn of the latest sample, counter-clockwise positive
+	 * @return ESP_ERR_INVALID_STATE when the encoder is not running
+	 */
+	std::expected<fastMath::Angle, std::error_code> getAngle() const;
 
 	std::expected<std::shared_ptr<Mt6701_spi>, std::error_code> getDevice();
 
+	/**
+	 * @brief Samples the encoder and publishes a new snapshot
+	 * @note Only the current sampler may call this, see setExternalSampler()
+	 * @return esp_err_t on error
+	 */
+	std::error_code sample();
+
+	/**
+	 * @brief Hands sampling over to another task, e.g. the FOC loop, so the shaft is
+	 *        sampled exactly once per control cycle. run() stops sampling while claimed
+	 * @note Claiming waits until a sample() run() is in the middle of has finished. Hand sampling
+	 *       back from the external sampler itself, between two of its samples.
+	 * @param external True to claim sampling, false to hand it back to run()
+	 */
+	void setExternalSampler(bool external);
+
+	/**
+	 * @brief Latest published encoder state, safe to call from any task or core
+	 */
+	Snapshot snapshot() const { return m_snapshot.read(); }
+
+	/**
+	 * @brief Angle turned over the last windowMs, counter-clockwise positive
+	 * @note Covers at most the length of the history, about two seconds
+	 */
+	float angleDelta(uint32_t windowMs) const;
+
+	/**
+	 * @brief Velocity of largest magnitude over the last windowMs, in radians per second, keeps its sign
+	 */
+	float peakVelocity(uint32_t windowMs) const;
+
+	/**
+	 * @brief Looks for a flick, a short burst of speed from (nearly) standing still, within the last windowMs
+	 * @return 1 for a counter-clockwise flick, -1 for clockwise, 0 when there was none. Spinning the
+	 *         knob fast for a while is not a flick.
+	 */
+	int flickDirection(uint32_t windowMs) const;
+
+	/**
+	 * @brief Whole revolutions turned since a point in time, counter-clockwise positive
+	 * @param timestampUs esp_timer time in microseconds
+	 * @return ESP_ERR_NOT_FOUND when the time is older than the history
+	 */
+	std::expected<int32_t, std::error_code> fullRotationsSince(int64_t timestampUs) const;
+
+	/**
+	 * @brief Whether no linearity correction table has been calibrated yet
+	 */
+	bool needsLinearityCalibration() { return m_config.isDefault(); }
+
+	/**
+	 * @brief Enables or disables applying the saved linearity table, disable it while calibrating
+	 */
+	void setLinearityCorrection(bool enabled);
+
+	/**
+	 * @brief Saves a new linearity table to flash and starts applying it
+	 * @return esp_err_t on error
+	 */
+	std::error_code saveLinearityTable(const EncoderLinearity::Table& table);
+
+	/**
+	 * @brief Single-turn count of the last sample, before linearity correction
+	 */
+	uint16_t getRawCount() const { return m_rawCount.load(std::memory_order_relaxed); }
+
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+	/**
+	 * @brief Resync counts and the drift the SSI reads found in the ABZ count, safe to call from any task
+	 */
+	IncrementalEncoder::Stats getIncrementalStats() const { return m_incremental.stats(); }
+#endif
+
 private:
 	static const inline char TAG[] = "Magnetic encoder";
 
+	// MT6701 SSI frame: 14 bit angle, 4 bit status and 6 bit CRC
+	static constexpr size_t m_ssiFrameLength = 3;
+
 	spi_device_handle_t m_spiDev;
 	spi_bus_config_t m_spiBusCfg {
 		.mosi_io_num = -1,
@@ -63,14 +203,104 @@ private:
 	};
 
 	static constexpr float m_filterCutoffHz = 10.0f;
-	static constexpr float m_encoderUpdatePeriod = 0.001f; // seconds
+	// The Butterworth cutoff is relative to the sample rate, which depends on whether run() or the FOC
+	// task samples. The filter is rebuilt once the smoothed period moved this far from the one it was
+	// built for, longer gaps than the maximum are pauses and not periods.
+	static constexpr float m_filterRetuneTolerance = 0.2f;
+	static constexpr float m_periodSmoothing       = 16.0f; // samples
+	static constexpr float m_maxFilterPeriodUs     = 20000.0f;
+
+	// Two seconds of history, a flick takes well over one interval
+	static constexpr size_t  m_historyLength     = 512;
+	static constexpr int64_t m_historyIntervalUs = 4000;
+	// A flick reaches this speed (rad/s), starting below a quarter of it at most this long before
+	static constexpr float   m_flickVelocity = 15.0f;
+	static constexpr int64_t m_flickRiseUs   = 80 * 1000;
+
+	static constexpr float m_countsToRadians = fastMath::tau / mt6701Frame::countsPerRevolution;
+	static constexpr float m_radiansPerSecondToRpm = 60.0f / fastMath::tau;
+
+	// Pre-built transaction for the fast read path, only the rx_data field changes per read
+	spi_transaction_t m_transaction {
+		.flags = SPI_TRANS_USE_RXDATA,
+		.cmd = 0,
+		.addr = 0,
+		.length = m_ssiFrameLength * 8,
+		.rxlength = m_ssiFrameLength * 8,
+		.user = nullptr,
+		.tx_buffer = nullptr,
+		.rx_buffer = nullptr,
+	};
 
-	ButterFilter m_filter;
-	float m_filterFn(float raw) { return m_filter.update(raw); };
+	VelocityObserver m_observer{CONFIG_MAGNETIC_ENCODER_VELOCITY_BANDWIDTH};
+
+	// Butterworth estimator, built for the measured sample period and only touched by the sampler
+	std::optional<ButterFilter> m_filter;
+	float                       m_filterPeriodUs = 0.0f; ///< Period m_filter was built for
+	float                       m_samplePeriodUs = 0.0f; ///< Smoothed time between reads
+	int64_t                     m_filterReadUs   = 0;    ///< Time of the read the filter last saw
 
 	std::shared_ptr<Mt6701_spi> m_dev;
 
-	bool read(uint8_t* data, size_t len) const;
+	Config                m_config;
+	EncoderLinearity      m_linearity;
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+	IncrementalEncoder    m_incremental;
+#endif
+	std::atomic<uint16_t> m_rawCount{0};
+
+	// Corrected count and time of the last read, only touched by the sampler
+	uint16_t m_lastCount  = 0;
+	int64_t  m_lastReadUs = 0;
+
+	std::atomic<bool> m_externalSampler{false};
+	std::atomic<bool> m_runSampling{false}; ///< run() is inside sample()
+	uint32_t          m_sampleCount = 0;
+	SeqLock<Snapshot> m_snapshot;
+
+	// History, the peak is tracked over the current interval by the sampler. On the heap, the encoder
+	// itself usually lives on a task stack.
+	std::unique_ptr<HistoryBuffer<HistorySample, m_historyLength>> m_history =
+			std::make_unique<HistoryBuffer<HistorySample, m_historyLength>>();
+	float   m_intervalPeakVelocity = 0.0f;
+	int64_t m_lastHistoryUs        = 0;
+
+	/**
+	 * @brief Read callback for the Mt6701 driver, takes the fast path for regular SSI frames
+	 *        and applies linearity correction before the driver decodes them. In hybrid mode most
+	 *        frames are built from the ABZ count instead of read.
+	 */
+	bool read(uint8_t* data, size_t len);
+
+	/**
+	 * @brief Reads a regular SSI frame over the fastest available path
+	 */
+	bool readFrame(uint8_t* data, size_t len);
+
+	/**
+	 * @brief Velocity callback for the Mt6701 driver, runs right after read() on every update
+	 * @param rawRpm The driver's own differentiated velocity, only used by the Butterworth estimator
+	 * @return Velocity in RPM
+	 */
+	float estimateVelocity(float rawRpm);
+
+	/**
+	 * @brief Polls the pre-built transaction, fastest when the bus is acquired by this device
+	 */
+	bool readPolling(uint8_t* data, size_t len);
+
+	/**
+	 * @brief Builds a transaction and waits for the SPI interrupt, works for any length
+	 */
+	bool readInterrupt(uint8_t* data, size_t len) const;
+
+#ifdef CONFIG_MAGNETIC_ENCODER_BENCHMARK
+	/**
+	 * @brief Logs the average time per read of both read paths, the interrupt path locking the bus per read
+	 *        and the polling path holding it when the fast read does
+	 */
+	void benchmarkRead();
+#endif
 };
 
 
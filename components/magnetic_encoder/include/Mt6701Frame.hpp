@@ -0,0 +1,56 @@
+#ifndef FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_MT6701FRAME_HPP
+#define FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_MT6701FRAME_HPP
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Encoding and decoding of the 24 bit MT6701 SSI frame
+ *
+ * Frame layout, MSB first: 14 bit angle, 4 bit status, 6 bit CRC over the angle and status bits.
+ * Used to adjust frames before they are handed to the espp Mt6701 driver.
+ *
+ * @note MT6701 datasheet: https://www.magntek.com.cn/upload/MT6701_Rev.1.8.pdf
+ */
+namespace mt6701Frame {
+
+    static constexpr uint16_t countsPerRevolution = 1 << 14;
+
+    // CRC6 with polynomial x^6 + x + 1, processed 6 bits at a time
+    static constexpr std::array<uint8_t, 64> crcTable = [] {
+        std::array<uint8_t, 64> table{};
+        for (uint8_t i = 0; i < table.size(); i++) {
+            uint8_t crc = i;
+            for (int bit = 0; bit < 6; bit++) {
+                crc = (crc & 0x20) ? (((crc << 1) & 0x3F) ^ 0x03) : ((crc << 1) & 0x3F);
+            }
+            table[i] = crc;
+        }
+        return table;
+    }();
+
+    constexpr uint8_t crc6(const uint32_t payload) {
+        uint8_t crc = crcTable[(payload >> 12) & 0x3F];
+        crc         = crcTable[crc ^ ((payload >> 6) & 0x3F)];
+        return crcTable[crc ^ (payload & 0x3F)];
+    }
+
+    constexpr uint16_t decodeCount(const uint8_t* frame) {
+        return static_cast<uint16_t>((frame[0] << 6) | (frame[1] >> 2));
+    }
+
+    constexpr uint8_t decodeStatus(const uint8_t* frame) {
+        return static_cast<uint8_t>(((frame[1] & 0x03) << 2) | (frame[2] >> 6));
+    }
+
+    constexpr void encode(uint8_t* frame, const uint16_t count, const uint8_t status) {
+        const uint32_t payload = (static_cast<uint32_t>(count & (countsPerRevolution - 1)) << 4) | (status & 0x0F);
+        const uint32_t bits    = (payload << 6) | crc6(payload);
+        frame[0]               = static_cast<uint8_t>(bits >> 16);
+        frame[1]               = static_cast<uint8_t>(bits >> 8);
+        frame[2]               = static_cast<uint8_t>(bits);
+    }
+
+} // namespace mt6701Frame
+
+#endif // FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_MT6701FRAME_HPP
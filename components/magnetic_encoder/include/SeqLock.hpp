@@ -0,0 +1,54 @@
+#ifndef FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_SEQLOCK_HPP
+#define FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief Single writer, multiple reader sequence lock
+ *
+ * The writer never waits. A reader only retries when it overlapped a write, which for
+ * small values is a handful of instructions, so readers on either core never block.
+ *
+ * @tparam T Trivially copyable value to publish
+ */
+template<typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>, "SeqLock values are copied while being written");
+
+public:
+    /**
+     * @brief Publishes a new value, only one task may write
+     */
+    void write(const T& value) {
+        const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+        // Odd sequence marks a write in progress
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_value = value;
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Returns the last fully written value, safe to call from any task
+     */
+    T read() const {
+        T        value;
+        uint32_t before;
+        uint32_t after;
+        do {
+            before = m_sequence.load(std::memory_order_acquire);
+            value  = m_value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1));
+        return value;
+    }
+
+private:
+    std::atomic<uint32_t> m_sequence{0};
+    T                     m_value{};
+};
+
+#endif // FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_SEQLOCK_HPP
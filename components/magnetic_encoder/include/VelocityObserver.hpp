@@ -0,0 +1,66 @@
+#ifndef FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_VELOCITYOBSERVER_HPP
+#define FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_VELOCITYOBSERVER_HPP
+
+#include <cstdint>
+
+#include "FastMath.hpp"
+
+/**
+ * @brief Critically damped alpha-beta tracking observer estimating shaft velocity from angle samples
+ *
+ * The gains are derived from the real time since the previous sample, so the bandwidth stays the
+ * same whatever rate, or irregular timing, the encoder is sampled at, and the observer stays stable
+ * for any gap. Angles are single turn, the residual is taken as the shortest rotation, so wraparound
+ * needs no special handling. Tracks a constant velocity without lag, unlike a low-pass filter on
+ * differentiated angles. For short sample periods it behaves like a type 2 PLL.
+ */
+class VelocityObserver {
+public:
+    /**
+     * @param bandwidthHz Bandwidth of the observer, higher tracks faster but passes more quantization noise
+     */
+    explicit VelocityObserver(const float bandwidthHz) : m_omega(fastMath::tau * bandwidthHz) {}
+
+    /**
+     * @param radians Single-turn angle, any range
+     * @param timestampUs Time the angle was sampled, in microseconds
+     * @return Estimated velocity in radians per second
+     */
+    float update(const float radians, const int64_t timestampUs) {
+        const int64_t elapsedUs = timestampUs - m_lastTimestampUs;
+        m_lastTimestampUs       = timestampUs;
+
+        // First sample, or the shaft may have turned any amount since the last one: restart from the measurement
+        if (elapsedUs <= 0 || elapsedUs > m_maxGapUs) {
+            m_angle    = fastMath::wrapTwoPi(radians);
+            m_velocity = 0.0f;
+            return m_velocity;
+        }
+
+        // Both observer poles at exp(-omega * dt), approximated by a series that stays in (0, 1)
+        const float dt    = static_cast<float>(elapsedUs) * 1e-6f;
+        const float x     = m_omega * dt;
+        const float pole  = 1.0f / (1.0f + x * (1.0f + x * (0.5f + x * (1.0f / 6.0f))));
+        const float alpha = 1.0f - pole * pole;
+        const float beta  = (1.0f - pole) * (1.0f - pole);
+
+        const float predicted = m_angle + m_velocity * dt;
+        const float residual  = fastMath::shortestDifference(predicted, radians);
+        m_angle               = fastMath::wrapTwoPi(predicted + alpha * residual);
+        m_velocity += beta / dt * residual;
+        return m_velocity;
+    }
+
+    float velocity() const { return m_velocity; }
+
+private:
+    // Past this gap the shaft could have turned more than half a revolution unnoticed
+    static constexpr int64_t m_maxGapUs = 100 * 1000;
+
+    float   m_omega;
+    float   m_angle           = 0.0f;
+    float   m_velocity        = 0.0f;
+    int64_t m_lastTimestampUs = 0;
+};
+
+#endif // FIRMWARE_COMPONENTS_MAGNETIC_ENCODER_INCLUDE_VELOCITYOBSERVER_HPP
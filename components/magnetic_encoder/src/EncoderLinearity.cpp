@@ -0,0 +1,46 @@
+#include "EncoderLinearity.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr float countsToRadians = 2.0f * static_cast<float>(M_PI) / mt6701Frame::countsPerRevolution;
+
+void EncoderLinearity::Fit::addSample(const uint16_t count, const float errorCounts) {
+    const float angle = static_cast<float>(count) * countsToRadians;
+    for (size_t k = 0; k < m_harmonics; k++) {
+        const float harmonic = static_cast<float>(k + 1) * angle;
+        m_cos[k] += errorCounts * std::cos(harmonic);
+        m_sin[k] += errorCounts * std::sin(harmonic);
+    }
+    m_samples++;
+}
+
+EncoderLinearity::Table EncoderLinearity::Fit::table() const {
+    Table table{};
+    if (m_samples == 0) {
+        return table;
+    }
+
+    const float scale = 2.0f / static_cast<float>(m_samples);
+    for (size_t i = 0; i < tableSize; i++) {
+        const float angle = 2.0f * static_cast<float>(M_PI) * static_cast<float>(i) / tableSize;
+        float       error = 0.0f;
+        for (size_t k = 0; k < m_harmonics; k++) {
+            const float harmonic = static_cast<float>(k + 1) * angle;
+            error += scale * (m_cos[k] * std::cos(harmonic) + m_sin[k] * std::sin(harmonic));
+        }
+        table[i] = static_cast<int16_t>(std::clamp(std::round(error), static_cast<float>(INT16_MIN), static_cast<float>(INT16_MAX)));
+    }
+    return table;
+}
+
+void EncoderLinearity::load(const Table& table) {
+    auto interpolation = std::make_unique<Interpolation>();
+    std::copy(table.begin(), table.end(), interpolation->begin());
+    (*interpolation)[tableSize] = table[0];
+    m_current.store(interpolation.get(), std::memory_order_release);
+
+    // A sample started before the store may still read the table just replaced
+    m_previous = std::move(m_owned);
+    m_owned    = std::move(interpolation);
+}
@@ -0,0 +1,116 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+#include "IncrementalEncoder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <initializer_list>
+
+#include "esp_system_error.hpp"
+
+std::error_code IncrementalEncoder::initialize() {
+    // Reaching either limit resets the count to 0, so the count wraps once per revolution
+    const pcnt_unit_config_t unitConfig{
+            .low_limit  = -countsPerRevolution,
+            .high_limit = countsPerRevolution,
+    };
+    if (const auto err = pcnt_new_unit(&unitConfig, &m_unit)) {
+        return std::make_error_code(err);
+    }
+
+    const pcnt_glitch_filter_config_t filterConfig{.max_glitch_ns = m_glitchFilterNs};
+    if (const auto err = pcnt_unit_set_glitch_filter(m_unit, &filterConfig)) {
+        return std::make_error_code(err);
+    }
+
+    // Full quadrature decoding: each channel counts both edges of one signal, the other sets the direction
+    const pcnt_chan_config_t channelAConfig{
+            .edge_gpio_num  = CONFIG_MAGNETIC_ENCODER_ABZ_A_GPIO,
+            .level_gpio_num = CONFIG_MAGNETIC_ENCODER_ABZ_B_GPIO,
+    };
+    const pcnt_chan_config_t channelBConfig{
+            .edge_gpio_num  = CONFIG_MAGNETIC_ENCODER_ABZ_B_GPIO,
+            .level_gpio_num = CONFIG_MAGNETIC_ENCODER_ABZ_A_GPIO,
+    };
+    if (const auto err = pcnt_new_channel(m_unit, &channelAConfig, &m_channelA)) {
+        return std::make_error_code(err);
+    }
+    if (const auto err = pcnt_new_channel(m_unit, &channelBConfig, &m_channelB)) {
+        return std::make_error_code(err);
+    }
+    for (const esp_err_t err : {
+                 pcnt_channel_set_edge_action(m_channelA, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE),
+                 pcnt_channel_set_level_action(m_channelA, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE),
+                 pcnt_channel_set_edge_action(m_channelB, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE),
+                 pcnt_channel_set_level_action(m_channelB, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE),
+         }) {
+        if (err) {
+            return std::make_error_code(err);
+        }
+    }
+
+    if (const auto err = pcnt_unit_enable(m_unit)) {
+        return std::make_error_code(err);
+    }
+    if (const auto err = pcnt_unit_clear_count(m_unit)) {
+        return std::make_error_code(err);
+    }
+    if (const auto err = pcnt_unit_start(m_unit)) {
+        return std::make_error_code(err);
+    }
+    m_synced = false;
+    return {};
+}
+
+void IncrementalEncoder::stop() {
+    if (m_unit == nullptr) {
+        return;
+    }
+    pcnt_unit_stop(m_unit);
+    pcnt_unit_disable(m_unit);
+    pcnt_del_channel(m_channelA);
+    pcnt_del_channel(m_channelB);
+    pcnt_del_unit(m_unit);
+    m_unit     = nullptr;
+    m_channelA = nullptr;
+    m_channelB = nullptr;
+    m_synced   = false;
+}
+
+int IncrementalEncoder::pulses() const {
+    int pulses = 0;
+    pcnt_unit_get_count(m_unit, &pulses);
+    return pulses;
+}
+
+uint16_t IncrementalEncoder::count() {
+    m_samplesSinceResync++;
+    // Unsigned arithmetic wraps negative counts onto the revolution
+    const auto scaled = static_cast<uint16_t>(static_cast<uint32_t>(pulses()) * m_countsPerPulse);
+    return static_cast<uint16_t>((m_offset + scaled) & (mt6701Frame::countsPerRevolution - 1));
+}
+
+void IncrementalEncoder::resync(const uint16_t ssiCount, const int pulsesBefore) {
+    const int pulsesAfter = pulses();
+    if (pulsesAfter != pulsesBefore) {
+        m_skippedResyncs.store(m_skippedResyncs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    if (m_synced) {
+        // Drift as the shortest way round from the predicted to the absolute count
+        const uint16_t predicted = count();
+        const int32_t  wrapped   = static_cast<int16_t>(static_cast<uint16_t>((ssiCount - predicted) << 2)) >> 2;
+        const auto     error     = static_cast<uint32_t>(std::abs(wrapped));
+        m_lastError.store(error, std::memory_order_relaxed);
+        m_maxError.store(std::max(error, m_maxError.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    const auto scaled = static_cast<uint16_t>(static_cast<uint32_t>(pulsesAfter) * m_countsPerPulse);
+    m_offset             = static_cast<uint16_t>((ssiCount - scaled) & (mt6701Frame::countsPerRevolution - 1));
+    m_synced             = true;
+    m_samplesSinceResync = 0;
+    m_resyncs.store(m_resyncs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+#endif
@@ -1,5 +1,13 @@
 #include "../include/MagneticEncoder.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include "esp_log.h"
 #include "esp_system_error.hpp"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 using Status = sdk::Component::Status;
 using res    = sdk::Component::res;
@@ -13,11 +21,36 @@ Status MagneticEncoder::initialize() {
     ret = spi_bus_add_device(spi_num, &m_spiDevCfg, &m_spiDev);
     ESP_ERROR_CHECK(ret);
 
+#ifdef CONFIG_MAGNETIC_ENCODER_FAST_READ
+    // The encoder has the bus to itself, holding it skips the bus lock on every read
+    ret = spi_device_acquire_bus(m_spiDev, portMAX_DELAY);
+    ESP_ERROR_CHECK(ret);
+#endif
+
+#ifdef CONFIG_MAGNETIC_ENCODER_BENCHMARK
+    benchmarkRead();
+#endif
+
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+    if (const auto err = m_incremental.initialize()) {
+        ESP_LOGE(TAG, "Unable to set up ABZ counting: %s", err.message().c_str());
+        m_err = err.value();
+        return m_status = Status::ERROR;
+    }
+    ESP_LOGI(TAG, "Counting ABZ edges, SSI resync every %lu samples", IncrementalEncoder::resyncInterval);
+#endif
+
+    if (!m_config.isDefault()) {
+        m_linearity.load(m_config.linearityTable.value());
+        ESP_LOGI(TAG, "Applying saved linearity correction");
+    }
+
     m_dev->set_log_verbosity(espp::Logger::Verbosity::NONE);
     std::error_code err;
     m_dev->initialize(false, err);
 
-    if (err) {
+    // Publish a first snapshot so readers never see an empty one
+    if (err || sample()) {
         m_err = ESP_FAIL;
         return m_status = Status::ERROR;
     }
@@ -25,8 +58,15 @@ Status MagneticEncoder::initialize() {
 }
 
 Status MagneticEncoder::run() {
-    std::error_code err;
-    m_dev->update(err);
+    // Flagged before the owner is checked, see setExternalSampler()
+    m_runSampling.store(true);
+    if (m_externalSampler.load()) {
+        m_runSampling.store(false);
+        return m_status;
+    }
+
+    const auto err = sample();
+    m_runSampling.store(false);
     if (err) {
         m_err = ESP_FAIL;
         return m_status = Status::ERROR;
@@ -35,7 +75,130 @@ Status MagneticEncoder::run() {
     return m_status = Status::RUNNING;
 }
 
+void MagneticEncoder::setExternalSampler(const bool external) {
+    // Sequentially consistent on both sides: run() flags itself before it checks the owner and this
+    // publishes the owner before it checks the flag, so at least one of them sees the other. Handing
+    // back, the stores also publish everything the external sampler wrote to run().
+    m_externalSampler.store(external);
+    // run() may run on the same core at a lower priority, it has to be let in to finish
+    while (m_runSampling.load()) {
+        vTaskDelay(1);
+    }
+}
+
+std::error_code MagneticEncoder::sample() {
+    std::error_code err;
+    m_dev->update(err);
+    if (err) {
+        return err;
+    }
+
+    const Snapshot snapshot{
+            .radians   = m_dev->get_radians(),
+            .velocity  = m_dev->get_rpm() * static_cast<float>(2.0 * M_PI / 60.0),
+            .timestamp = m_lastReadUs,
+            .sequence  = ++m_sampleCount,
+    };
+    m_snapshot.write(snapshot);
+
+    if (std::fabs(snapshot.velocity) > std::fabs(m_intervalPeakVelocity)) {
+        m_intervalPeakVelocity = snapshot.velocity;
+    }
+    if (snapshot.timestamp - m_lastHistoryUs >= m_historyIntervalUs) {
+        m_history->push({.radians = snapshot.radians, .peakVelocity = m_intervalPeakVelocity, .timestamp = snapshot.timestamp});
+        m_intervalPeakVelocity = 0.0f;
+        m_lastHistoryUs        = snapshot.timestamp;
+    }
+    return {};
+}
+
+float MagneticEncoder::angleDelta(const uint32_t windowMs) const {
+    const int64_t since = esp_timer_get_time() - static_cast<int64_t>(windowMs) * 1000;
+    return m_history->read([since](const auto& history) {
+        if (history.size() == 0) {
+            return 0.0f;
+        }
+        // Newest sample against the last one taken before the window started
+        size_t age = 0;
+        while (age + 1 < history.size() && history[age].timestamp > since) {
+            age++;
+        }
+        return history[0].radians - history[age].radians;
+    });
+}
+
+float MagneticEncoder::peakVelocity(const uint32_t windowMs) const {
+    const int64_t since = esp_timer_get_time() - static_cast<int64_t>(windowMs) * 1000;
+    return m_history->read([since](const auto& history) {
+        float peak = 0.0f;
+        for (size_t age = 0; age < history.size(); age++) {
+            const HistorySample sample = history[age];
+            if (sample.timestamp < since) {
+                break;
+            }
+            if (std::fabs(sample.peakVelocity) > std::fabs(peak)) {
+                peak = sample.peakVelocity;
+            }
+        }
+        return peak;
+    });
+}
+
+int MagneticEncoder::flickDirection(const uint32_t windowMs) const {
+    const int64_t since = esp_timer_get_time() - static_cast<int64_t>(windowMs) * 1000;
+    return m_history->read([since](const auto& history) {
+        // Fastest interval within the window
+        size_t peakAge = 0;
+        float  peak    = 0.0f;
+        for (size_t age = 0; age < history.size(); age++) {
+            const HistorySample sample = history[age];
+            if (sample.timestamp < since) {
+                break;
+            }
+            if (std::fabs(sample.peakVelocity) > std::fabs(peak)) {
+                peak    = sample.peakVelocity;
+                peakAge = age;
+            }
+        }
+        if (std::fabs(peak) < m_flickVelocity) {
+            return 0;
+        }
+
+        // It must have sped up from nearly standing still shortly before, otherwise the knob was spun
+        const int64_t peakTimestamp = history[peakAge].timestamp;
+        for (size_t age = peakAge + 1; age < history.size(); age++) {
+            const HistorySample sample = history[age];
+            if (peakTimestamp - sample.timestamp > m_flickRiseUs) {
+                break;
+            }
+            if (std::fabs(sample.peakVelocity) < m_flickVelocity / 4.0f) {
+                return peak > 0.0f ? 1 : -1;
+            }
+        }
+        return 0;
+    });
+}
+
+std::expected<int32_t, std::error_code> MagneticEncoder::fullRotationsSince(const int64_t timestampUs) const {
+    return m_history->read([timestampUs](const auto& history) -> std::expected<int32_t, std::error_code> {
+        // The last sample taken at or before the requested time
+        for (size_t age = 0; age < history.size(); age++) {
+            if (history[age].timestamp <= timestampUs) {
+                return static_cast<int32_t>((history[0].radians - history[age].radians) / fastMath::tau);
+            }
+        }
+        return std::unexpected(std::make_error_code(ESP_ERR_NOT_FOUND));
+    });
+}
+
 Status MagneticEncoder::stop() {
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+    m_incremental.stop();
+#endif
+#ifdef CONFIG_MAGNETIC_ENCODER_FAST_READ
+    spi_device_release_bus(m_spiDev);
+#endif
+
     auto err = spi_bus_remove_device(m_spiDev);
     if (err != ESP_OK) {
         m_err = err;
@@ -51,7 +214,98 @@ Status MagneticEncoder::stop() {
     return m_status = Status::STOPPED;
 }
 
-bool MagneticEncoder::read(uint8_t* data, size_t len) const {
+void MagneticEncoder::setLinearityCorrection(const bool enabled) {
+    if (!enabled) {
+        m_linearity.clear();
+    } else if (!m_config.isDefault() && !m_linearity.isActive()) {
+        m_linearity.load(m_config.linearityTable.value());
+    }
+}
+
+std::error_code MagneticEncoder::saveLinearityTable(const EncoderLinearity::Table& table) {
+    m_config.updateField(m_config.linearityTable, table);
+    if (const auto err = m_config.save()) {
+        ESP_LOGW(TAG, "Unable to save config: %s - %s", esp_err_to_name(err.value()), err.message().c_str());
+        return err;
+    }
+
+    m_linearity.load(table);
+    return {};
+}
+
+bool MagneticEncoder::read(uint8_t* data, size_t len) {
+    if (len != m_ssiFrameLength) {
+        return readInterrupt(data, len);
+    }
+
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+    if (m_incremental.resyncDue()) {
+        const int pulses = m_incremental.pulses();
+        if (!readFrame(data, len)) {
+            return false;
+        }
+        m_incremental.resync(mt6701Frame::decodeCount(data), pulses);
+    } else {
+        // Same frame as the encoder would send, so linearity correction and the driver treat it alike
+        mt6701Frame::encode(data, m_incremental.count(), 0);
+    }
+#else
+    if (!readFrame(data, len)) {
+        return false;
+    }
+#endif
+    m_lastReadUs = esp_timer_get_time();
+
+    const uint16_t count = mt6701Frame::decodeCount(data);
+    m_rawCount.store(count, std::memory_order_relaxed);
+    m_lastCount = count;
+    if (const auto corrected = m_linearity.correct(count)) {
+        // Re-encode so the driver's own decoding (and CRC check) sees the corrected angle
+        m_lastCount = *corrected;
+        mt6701Frame::encode(data, m_lastCount, mt6701Frame::decodeStatus(data));
+    }
+    return true;
+}
+
+bool MagneticEncoder::readFrame(uint8_t* data, const size_t len) {
+#ifdef CONFIG_MAGNETIC_ENCODER_FAST_READ
+    return readPolling(data, len);
+#else
+    return readInterrupt(data, len);
+#endif
+}
+
+float MagneticEncoder::estimateVelocity(const float rawRpm) {
+#ifdef CONFIG_MAGNETIC_ENCODER_VELOCITY_OBSERVER
+    // The raw velocity is ignored, the observer works from the corrected angle and the time it was read
+    return m_observer.update(static_cast<float>(m_lastCount) * m_countsToRadians, m_lastReadUs) * m_radiansPerSecondToRpm;
+#else
+    const auto periodUs = static_cast<float>(m_lastReadUs - m_filterReadUs);
+    m_filterReadUs      = m_lastReadUs;
+    if (periodUs > 0.0f && periodUs <= m_maxFilterPeriodUs) {
+        m_samplePeriodUs = m_samplePeriodUs == 0.0f ? periodUs : m_samplePeriodUs + (periodUs - m_samplePeriodUs) / m_periodSmoothing;
+    }
+    if (m_samplePeriodUs == 0.0f) {
+        // No period measured yet, the first sample's raw velocity has nothing to differentiate against either
+        return 0.0f;
+    }
+
+    if (!m_filter || fastMath::abs(m_samplePeriodUs - m_filterPeriodUs) > m_filterRetuneTolerance * m_filterPeriodUs) {
+        m_filterPeriodUs = m_samplePeriodUs;
+        m_filter.emplace(ButterFilter::Config{.normalized_cutoff_frequency = 2.0f * m_filterCutoffHz * m_filterPeriodUs * 1e-6f});
+    }
+    return m_filter->update(rawRpm);
+#endif
+}
+
+bool MagneticEncoder::readPolling(uint8_t* data, size_t len) {
+    // Busy-waits for the ~3us transfer, much cheaper than the interrupt + context switch round trip
+    if (spi_device_polling_transmit(m_spiDev, &m_transaction) != ESP_OK) { return false; }
+    std::memcpy(data, m_transaction.rx_data, len);
+    return true;
+}
+
+bool MagneticEncoder::readInterrupt(uint8_t* data, size_t len) const {
     // we can use the SPI_TRANS_USE_RXDATA since our length is <= 4 bytes (32
     // bits), this means we can directly use the tarnsaction's rx_data field
     static constexpr uint8_t SPIBUS_READ = 0x80;
@@ -78,14 +332,37 @@ bool MagneticEncoder::read(uint8_t* data, size_t len) const {
     return true;
 }
 
-std::expected<double, std::error_code> MagneticEncoder::getDegrees() const {
-    if (m_status < Status::RUNNING) { return std::unexpected(std::make_error_code(ESP_ERR_INVALID_STATE)); }
-    return m_dev->get_degrees() * -1.0l;
+#ifdef CONFIG_MAGNETIC_ENCODER_BENCHMARK
+void MagneticEncoder::benchmarkRead() {
+    constexpr int iterations = 1000;
+    uint8_t       data[m_ssiFrameLength];
+
+#ifdef CONFIG_MAGNETIC_ENCODER_FAST_READ
+    // The interrupt path is timed as it runs without the fast read, locking the bus on every read
+    spi_device_release_bus(m_spiDev);
+#endif
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) { readInterrupt(data, m_ssiFrameLength); }
+    const float interruptUs = static_cast<float>(esp_timer_get_time() - start) / iterations;
+#ifdef CONFIG_MAGNETIC_ENCODER_FAST_READ
+    ESP_ERROR_CHECK(spi_device_acquire_bus(m_spiDev, portMAX_DELAY));
+    constexpr bool busHeld = true;
+#else
+    constexpr bool busHeld = false;
+#endif
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < iterations; i++) { readPolling(data, m_ssiFrameLength); }
+    const float pollingUs = static_cast<float>(esp_timer_get_time() - start) / iterations;
+
+    ESP_LOGI(TAG, "Read benchmark (%d reads): interrupt %.2f us/read, polling%s %.2f us/read", iterations, interruptUs,
+             busHeld ? " with the bus held" : "", pollingUs);
 }
+#endif
 
-std::expected<double, std::error_code> MagneticEncoder::getRadians() const {
+std::expected<fastMath::Angle, std::error_code> MagneticEncoder::getAngle() const {
     if (m_status < Status::RUNNING) { return std::unexpected(std::make_error_code(ESP_ERR_INVALID_STATE)); }
-    return m_dev->get_radians();
+    return snapshot().angle();
 }
 
 std::expected<std::shared_ptr<Mt6701_spi>, std::error_code> MagneticEncoder::getDevice() {
@@ -0,0 +1,85 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_COGGINGMAP_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_COGGINGMAP_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <expected>
+#include <system_error>
+
+#include "Mt6701Frame.hpp"
+
+/**
+ * @brief Feed-forward table of the cogging torque of the motor, indexed by the raw encoder count
+ *
+ * The table holds the command, in millivolts, that holds the rotor still against cogging at every angle.
+ * Adding it to the torque command cancels the cogging, feedForward() costs one interpolated lookup.
+ * Raw counts are used as the index, so the map does not depend on encoder linearity correction.
+ */
+class CoggingMap {
+public:
+    // 7 pole pairs on 12 slots cog 84 times per revolution, 512 bins keep 6 bins per period
+    static constexpr size_t tableSize = 512;
+    using Table                       = std::array<int16_t, tableSize>;
+
+    /**
+     * @brief Averages holding effort per angle bin over a slow sweep there and back
+     *
+     * Friction opposes the sweep, so it adds to the effort one way and subtracts the other. Averaging the
+     * two directions cancels it, the mean effort over the revolution (a spring or a tilted knob) is left out.
+     */
+    class Recorder {
+    public:
+        /**
+         * @brief Adds a sample to the table entry nearest to its count
+         * @param count Raw single-turn encoder count
+         * @param effort Command holding the rotor at this angle, volts
+         * @param returning False on the sweep out, true on the sweep back
+         */
+        void addSample(uint16_t count, float effort, bool returning);
+
+        /**
+         * @return ESP_ERR_INVALID_SIZE when a bin was not swept in both directions
+         */
+        std::expected<Table, std::error_code> table() const;
+
+        uint32_t samples() const { return m_samples; }
+
+    private:
+        std::array<std::array<float, tableSize>, 2>    m_sums{};
+        std::array<std::array<uint16_t, tableSize>, 2> m_counts{};
+        uint32_t                                       m_samples = 0;
+    };
+
+    /**
+     * @brief Loads a table and activates it
+     * @note Only call while inactive, the FOC task reads the table without locking
+     */
+    void load(const Table& table);
+    void clear() { m_active.store(false, std::memory_order_relaxed); }
+    bool isActive() const { return m_active.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Cogging compensation for a raw count, volts, 0 while inactive
+     */
+    float feedForward(const uint16_t count) const {
+        if (!isActive()) {
+            return 0.0f;
+        }
+        const uint32_t index = count >> m_binShift;
+        const int32_t  frac  = count & ((1 << m_binShift) - 1);
+        const int32_t  a     = m_table[index];
+        const int32_t  b     = m_table[index + 1];
+        return static_cast<float>(a + (((b - a) * frac) >> m_binShift)) * 0.001f;
+    }
+
+private:
+    static constexpr uint32_t m_binShift = 5;
+    static_assert((tableSize << m_binShift) == mt6701Frame::countsPerRevolution, "Table must cover exactly one revolution");
+
+    // One extra entry repeats the first, so interpolation never has to wrap the index
+    std::array<int16_t, tableSize + 1> m_table{};
+    std::atomic<bool>                  m_active{false};
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_COGGINGMAP_HPP
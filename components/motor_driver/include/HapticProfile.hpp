@@ -0,0 +1,231 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_HAPTICPROFILE_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_HAPTICPROFILE_HPP
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <expected>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "FastMath.hpp"
+#include "detent_config.hpp"
+
+/**
+ * @brief Precomputed torque versus angle table, evaluated once per FOC tick
+ *
+ * All shaping (detents, notches, snap points) is baked into the table by the Builder, the FOC task
+ * only interpolates it. A profile is immutable once built, which is what allows MotorDriver to hand
+ * it to the FOC task with a single pointer swap.
+ *
+ * Angles are "offsets": radians clockwise, as seen by the user, from the profile origin. Positions are
+ * numbered clockwise as well, matching espp::BldcHaptics. torque() is positive clockwise.
+ */
+class HapticProfile {
+public:
+    // Scales a feature strength (same units as espp DetentConfig strengths) into volts per radian
+    static constexpr float kpFactor = 2.0f;
+
+    class Builder {
+    public:
+        /**
+         * @param start Offset of the start of the table
+         * @param end Offset of the end of the table, larger than start
+         */
+        Builder(float start, float end) : m_start(start), m_end(end) {}
+
+        /**
+         * @brief Repeats the table forever, for unbounded profiles. Positions keep counting past the end.
+         */
+        Builder& periodic() {
+            m_periodic = true;
+            return *this;
+        }
+
+        /**
+         * @brief Springs pulling back towards the first and last position, lower strengths feel softer
+         */
+        Builder& endStops(const float strength) {
+            m_endStrength = strength;
+            return *this;
+        }
+
+        Builder& damping(const float voltsPerRadianPerSecond) {
+            m_damping = voltsPerRadianPerSecond;
+            return *this;
+        }
+
+        Builder& firstPosition(const int position) {
+            m_firstPosition = position;
+            return *this;
+        }
+
+        /**
+         * @brief Adds a position without torque, used to count positions between sparse detents
+         */
+        Builder& position(float center);
+
+        /**
+         * @brief Spring towards center within half a width either side, with a small dead zone. Adds a position.
+         */
+        Builder& detent(const float center, const float width, const float strength) {
+            return detent(center, width / 2.0f, width / 2.0f, strength);
+        }
+
+        /**
+         * @brief Asymmetric detent, spanning `before` counter-clockwise and `after` clockwise of center
+         */
+        Builder& detent(float center, float before, float after, float strength);
+
+        /**
+         * @brief Bump pushing away from center, felt as a click when turning past it. Does not add a position.
+         */
+        Builder& notch(float center, float width, float strength);
+
+        /**
+         * @brief Magnetic attraction towards center that fades out towards the edges of width. Adds a position.
+         */
+        Builder& snap(float center, float width, float strength);
+
+        /**
+         * @brief Moves the boundary between two neighbouring positions, by default it is halfway
+         * @param after Position, relative to the first position, before the boundary
+         */
+        Builder& boundary(size_t after, float offset);
+
+        std::unique_ptr<HapticProfile> build() const;
+
+    private:
+        struct Feature {
+            enum class Type { DETENT,
+                              NOTCH,
+                              SNAP };
+
+            Type  type;
+            float center;
+            float before;
+            float after;
+            float strength;
+        };
+
+        static float featureTorque(const Feature& feature, float distance);
+
+        float                                 m_start;
+        float                                 m_end;
+        bool                                  m_periodic      = false;
+        float                                 m_endStrength   = 0.0f;
+        float                                 m_damping       = 0.0f;
+        int                                   m_firstPosition = 0;
+        std::vector<Feature>                  m_features;
+        std::vector<float>                    m_positions;
+        std::vector<std::pair<size_t, float>> m_boundaryOverrides;
+    };
+
+    /**
+     * @brief Bakes an espp detent preset into a table
+     * @note The table has no state, so snap points past half a detent (used by espp for hysteresis)
+     *       are clamped to half a detent
+     */
+    static std::unique_ptr<HapticProfile> fromDetentConfig(const espp::detail::DetentConfig& config);
+
+    /**
+     * @brief Builds a profile from JSON, as stored in a config object or asset file
+     *
+     * Angles are in degrees clockwise, strengths use DetentConfig units:
+     * @code{.json}
+     * {
+     *     "start": -10, "end": 190, "periodic": false, "endStrength": 1, "damping": 0.02, "firstPosition": 0,
+     *     "features": [
+     *         {"type": "detent", "center": 0, "width": 20, "strength": 1.5},
+     *         {"type": "notch", "center": 45, "width": 6, "strength": 0.8},
+     *         {"type": "snap", "center": 180, "width": 30, "strength": 3}
+     *     ]
+     * }
+     * @endcode
+     */
+    static std::expected<std::unique_ptr<HapticProfile>, std::error_code> fromJson(const nlohmann::json& json);
+
+    /**
+     * @brief Reads and builds a JSON profile from a file, e.g. on the static assets partition
+     */
+    static std::expected<std::unique_ptr<HapticProfile>, std::error_code> fromFile(std::string_view path);
+
+    /**
+     * @brief Interpolated torque at an offset, end stops included, damping excluded
+     */
+    float torque(const float offset) const {
+        if (!m_periodic) {
+            if (offset < m_positions.front() && m_endStrength > 0.0f) {
+                return m_endStrength * (m_positions.front() - offset);
+            }
+            if (offset > m_positions.back() && m_endStrength > 0.0f) {
+                return m_endStrength * (m_positions.back() - offset);
+            }
+        }
+
+        float index = (offset - m_start) * m_samplesPerRadian;
+        if (m_periodic) {
+            index -= m_lastSample * fastMath::floor(index / m_lastSample);
+        } else {
+            index = std::clamp(index, 0.0f, m_lastSample);
+        }
+        const auto  i    = std::min(static_cast<size_t>(index), m_table.size() - 2);
+        const float frac = index - static_cast<float>(i);
+        return m_table[i] + frac * (m_table[i + 1] - m_table[i]);
+    }
+
+    /**
+     * @brief Motor torque command, counter-clockwise positive like the shaft angle, for the knob at an offset
+     * @param velocity Shaft velocity, counter-clockwise positive
+     * @param limit Largest command magnitude, usually the supply voltage
+     */
+    float command(const float offset, const float velocity, const float limit) const {
+        return std::clamp(-torque(offset) - m_damping * velocity, -limit, limit);
+    }
+
+    /**
+     * @brief Position at an offset, positions outside the table are clamped unless periodic
+     */
+    int positionAt(float offset) const;
+
+    /**
+     * @brief Offset of the center of a position
+     */
+    float offsetOf(int position) const;
+
+    float damping() const { return m_damping; }
+    int   minPosition() const { return m_firstPosition; }
+    int   maxPosition() const { return m_firstPosition + static_cast<int>(m_positions.size()) - 1; }
+    bool  isPeriodic() const { return m_periodic; }
+
+    /**
+     * @brief Position the knob starts at once the profile is activated
+     */
+    int  startPosition() const { return m_startPosition; }
+    void setStartPosition(int position);
+
+private:
+    HapticProfile() = default;
+
+    // Guarantees a few samples across every feature, so interpolation does not wash out sharp edges
+    static constexpr float  m_samplesPerFeatureWidth = 16.0f;
+    static constexpr size_t m_minSamples             = 64;
+    static constexpr size_t m_maxSamples             = 4096;
+
+    std::vector<float> m_table;
+    float              m_start            = 0.0f;
+    float              m_period           = 0.0f;
+    float              m_samplesPerRadian = 0.0f;
+    float              m_lastSample       = 0.0f;
+    bool               m_periodic         = false;
+    float              m_endStrength      = 0.0f;
+    float              m_damping          = 0.0f;
+    std::vector<float> m_positions;
+    std::vector<float> m_boundaries;
+    int                m_firstPosition = 0;
+    int                m_startPosition = 0;
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_HAPTICPROFILE_HPP
@@ -0,0 +1,160 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_HAPTICWAVEFORM_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_HAPTICWAVEFORM_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include "FastMath.hpp"
+#include "sdkconfig.h"
+
+/**
+ * @brief Short torque effects, stored as 8 bit tables and mixed into the torque command by the FOC task
+ *
+ * Tables are sampled at a fixed rate, independent of the FOC loop frequency, and built at compile time.
+ * Full scale (127) maps to the amplitude an effect is played with. The player interpolates the table at
+ * the FOC tick rate, so playback costs a table read and a multiply per voice per tick.
+ */
+namespace hapticWaveform {
+    enum class Effect : uint8_t {
+        CLICK,       ///< Single short tick, like a detent
+        DOUBLE_TICK, ///< Two clicks in quick succession
+        BUZZ,        ///< Vibration for a few tens of milliseconds
+        WALL_HIT,    ///< Hard knock that rings down, like hitting an end stop
+        COUNT
+    };
+
+    static constexpr size_t   effectCount  = static_cast<size_t>(Effect::COUNT);
+    static constexpr uint32_t sampleRateHz = 2000;
+    static constexpr float    fullScale    = 127.0f;
+
+    namespace detail {
+        constexpr int8_t quantise(const float value) {
+            return static_cast<int8_t>(std::clamp(value * fullScale + (value < 0.0f ? -0.5f : 0.5f), -fullScale, fullScale));
+        }
+
+        // One period of a 250 Hz sine, fading out over the period
+        constexpr std::array<int8_t, 8> click = [] {
+            std::array<int8_t, 8> samples{};
+            for (size_t i = 0; i < samples.size(); i++) {
+                const float t = static_cast<float>(i) / static_cast<float>(samples.size());
+                samples[i]    = quantise(fastMath::sin(fastMath::tau * t) * (1.0f - t));
+            }
+            return samples;
+        }();
+
+        // Two clicks 30 ms apart
+        constexpr std::array<int8_t, 68> doubleTick = [] {
+            std::array<int8_t, 68> samples{};
+            std::copy(click.begin(), click.end(), samples.begin());
+            std::copy(click.begin(), click.end(), samples.begin() + 60);
+            return samples;
+        }();
+
+        // 60 ms of 200 Hz at 60 % with 10 ms attack and release ramps
+        constexpr std::array<int8_t, 120> buzz = [] {
+            std::array<int8_t, 120> samples{};
+            constexpr float         ramp = 20.0f;
+            for (size_t i = 0; i < samples.size(); i++) {
+                const float t        = static_cast<float>(i);
+                const float envelope = std::min({1.0f, t / ramp, (static_cast<float>(samples.size()) - t) / ramp});
+                samples[i]           = quantise(0.6f * envelope * fastMath::sin(fastMath::tau * 200.0f * t / sampleRateHz));
+            }
+            return samples;
+        }();
+
+        // Full scale knock, then a 100 Hz ring decaying by ~20 dB every 10 ms
+        constexpr std::array<int8_t, 60> wallHit = [] {
+            std::array<int8_t, 60> samples{};
+            float                  envelope = 1.0f;
+            for (size_t i = 0; i < samples.size(); i++) {
+                const float t = static_cast<float>(i);
+                samples[i]    = quantise(envelope * fastMath::cos(fastMath::tau * 100.0f * t / sampleRateHz));
+                envelope *= 0.891f;
+            }
+            return samples;
+        }();
+
+        constexpr std::array<std::span<const int8_t>, effectCount> tables{click, doubleTick, buzz, wallHit};
+    } // namespace detail
+
+    /**
+     * @brief Table of an effect, samples at sampleRateHz
+     */
+    constexpr std::span<const int8_t> table(const Effect effect) { return detail::tables[static_cast<size_t>(effect)]; }
+} // namespace hapticWaveform
+
+/**
+ * @brief Plays triggered waveforms, only used by the FOC task
+ *
+ * A few voices play at once and are summed, a trigger with all voices busy replaces the oldest.
+ */
+class WaveformPlayer {
+public:
+    struct Trigger {
+        hapticWaveform::Effect effect;
+        float                  amplitude; ///< Volts at full scale, the sign sets the direction of the first half wave
+    };
+
+    static constexpr size_t voiceCount = 2;
+
+    void trigger(const Trigger& trigger) {
+        if (static_cast<size_t>(trigger.effect) >= hapticWaveform::effectCount) {
+            return;
+        }
+        auto voice = std::min_element(m_voices.begin(), m_voices.end(), [](const Voice& a, const Voice& b) {
+            // Idle voices first, then the one that started first
+            return a.samples.empty() != b.samples.empty() ? a.samples.empty() : a.age > b.age;
+        });
+        *voice = {.samples = hapticWaveform::table(trigger.effect), .scale = trigger.amplitude / hapticWaveform::fullScale};
+    }
+
+    /**
+     * @brief Advances all voices by one FOC tick
+     * @return Summed command of all voices for this tick, volts
+     */
+    float step() {
+        float command = 0.0f;
+        for (auto& voice : m_voices) {
+            if (voice.samples.empty()) {
+                continue;
+            }
+            const size_t index = voice.phase >> m_phaseBits;
+            if (index >= voice.samples.size()) {
+                voice = {};
+                continue;
+            }
+
+            // Linear interpolation, towards 0 past the last sample
+            const float current  = voice.samples[index];
+            const float next     = index + 1 < voice.samples.size() ? voice.samples[index + 1] : 0.0f;
+            const float fraction = static_cast<float>(voice.phase & m_phaseMask) / static_cast<float>(m_phaseMask + 1);
+            command += voice.scale * (current + fraction * (next - current));
+
+            voice.phase += m_phaseStep;
+            voice.age++;
+        }
+        return command;
+    }
+
+    bool playing() const {
+        return std::any_of(m_voices.begin(), m_voices.end(), [](const Voice& voice) { return !voice.samples.empty(); });
+    }
+
+private:
+    struct Voice {
+        std::span<const int8_t> samples{};
+        float                   scale = 0.0f;
+        uint32_t                phase = 0; ///< Table position, fixed point with m_phaseBits fraction bits
+        uint32_t                age   = 0;
+    };
+
+    static constexpr uint32_t m_phaseBits = 16;
+    static constexpr uint32_t m_phaseMask = (1u << m_phaseBits) - 1;
+    static constexpr uint32_t m_phaseStep = (hapticWaveform::sampleRateHz << m_phaseBits) / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+
+    std::array<Voice, voiceCount> m_voices{};
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_HAPTICWAVEFORM_HPP
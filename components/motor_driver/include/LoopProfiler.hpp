@@ -0,0 +1,194 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_LOOPPROFILER_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_LOOPPROFILER_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief Cycle count histograms of the stages of the FOC loop
+ *
+ * Every probe reads CCOUNT on entry and exit and drops the difference in a fixed-width bucket, counting
+ * samples over the stage's budget as overruns. Only the FOC task records, other tasks take snapshots, so
+ * counters are plain relaxed loads and stores without read-modify-write. A probe costs around a dozen
+ * cycles. With CONFIG_MOTOR_DRIVER_LOOP_PROFILER disabled Scope is empty and probes compile to nothing.
+ */
+class LoopProfiler {
+public:
+    enum class Probe : uint8_t {
+        TICK,         ///< Whole FOC tick
+        ENCODER_READ, ///< MagneticEncoder::sample()
+        HAPTICS,      ///< Haptic or homing torque command
+        FOC,          ///< BldcMotor::loop_foc(), PWM update included
+        PWM,          ///< BldcDriver::set_voltage()
+        COUNT
+    };
+
+    static constexpr size_t probeCount = static_cast<size_t>(Probe::COUNT);
+    static constexpr size_t bucketCount = 64;
+
+    struct ProbeStats {
+        const char* name;
+        uint32_t    samples;
+        uint32_t    p50;      ///< Cycles, upper edge of the bucket holding the median
+        uint32_t    p99;      ///< Cycles, upper edge of the bucket holding the 99th percentile
+        uint32_t    max;      ///< Cycles
+        uint32_t    budget;   ///< Cycles
+        uint32_t    overruns; ///< Samples over budget
+    };
+
+    struct Snapshot {
+        std::array<ProbeStats, probeCount> probes;
+        uint32_t                           cpuFrequencyMhz;
+    };
+
+#ifdef CONFIG_MOTOR_DRIVER_LOOP_PROFILER
+    /**
+     * @brief Times a stage from construction to destruction
+     */
+    class Scope {
+    public:
+        Scope(LoopProfiler& profiler, const Probe probe) : m_profiler(profiler), m_probe(probe), m_start(esp_cpu_get_cycle_count()) {}
+        ~Scope() { m_profiler.record(m_probe, esp_cpu_get_cycle_count() - m_start); }
+
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        LoopProfiler& m_profiler;
+        Probe         m_probe;
+        uint32_t      m_start;
+    };
+
+    /**
+     * @brief Adds a sample, only called by the FOC task
+     */
+    void record(const Probe probe, const uint32_t cycles) {
+        Histogram&   histogram = m_histograms[static_cast<size_t>(probe)];
+        const size_t bucket    = std::min<size_t>(cycles >> m_shifts[static_cast<size_t>(probe)], bucketCount - 1);
+        increment(histogram.buckets[bucket]);
+        if (cycles > histogram.max.load(std::memory_order_relaxed)) {
+            histogram.max.store(cycles, std::memory_order_relaxed);
+        }
+        if (cycles > m_budgets[static_cast<size_t>(probe)]) {
+            increment(histogram.overruns);
+        }
+    }
+
+    /**
+     * @brief Applies a pending reset, called by the FOC task at the start of a tick
+     */
+    void applyReset() {
+        if (!m_resetRequested.exchange(false, std::memory_order_relaxed)) {
+            return;
+        }
+        for (auto& histogram : m_histograms) {
+            for (auto& bucket : histogram.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            histogram.max.store(0, std::memory_order_relaxed);
+            histogram.overruns.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Clears all histograms on the next FOC tick, safe to call from any task
+     */
+    void reset() { m_resetRequested.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @brief Percentiles per probe, safe to call from any task. Buckets are read one by one while the FOC
+     *        task keeps recording, so counts may be off by the samples of a tick or two.
+     */
+    Snapshot snapshot() const {
+        Snapshot snapshot{.probes = {}, .cpuFrequencyMhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ};
+        for (size_t probe = 0; probe < probeCount; probe++) {
+            const Histogram& histogram = m_histograms[probe];
+
+            std::array<uint32_t, bucketCount> counts{};
+            uint32_t                          samples = 0;
+            for (size_t i = 0; i < bucketCount; i++) {
+                counts[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+                samples += counts[i];
+            }
+
+            const uint32_t max = histogram.max.load(std::memory_order_relaxed);
+            snapshot.probes[probe] = {
+                    .name     = m_names[probe],
+                    .samples  = samples,
+                    .p50      = percentile(counts, samples, m_shifts[probe], max, 50),
+                    .p99      = percentile(counts, samples, m_shifts[probe], max, 99),
+                    .max      = max,
+                    .budget   = m_budgets[probe],
+                    .overruns = histogram.overruns.load(std::memory_order_relaxed),
+            };
+        }
+        return snapshot;
+    }
+
+private:
+    struct Histogram {
+        std::array<std::atomic<uint32_t>, bucketCount> buckets{};
+        std::atomic<uint32_t>                          max{0};
+        std::atomic<uint32_t>                          overruns{0};
+    };
+
+    static void increment(std::atomic<uint32_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static uint32_t percentile(const std::array<uint32_t, bucketCount>& counts, const uint32_t samples, const uint32_t shift,
+                               const uint32_t max, const uint32_t percent) {
+        if (samples == 0) {
+            return 0;
+        }
+        const uint64_t rank       = (static_cast<uint64_t>(samples) * percent + 99) / 100;
+        uint64_t       cumulative = 0;
+        for (size_t i = 0; i < bucketCount - 1; i++) {
+            cumulative += counts[i];
+            if (cumulative >= rank) {
+                return std::min(static_cast<uint32_t>(((i + 1) << shift) - 1), max);
+            }
+        }
+        // The last bucket is open ended
+        return max;
+    }
+
+    static constexpr uint32_t m_tickCycles = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000 / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+
+    // Budgets per stage, as a share of the tick period, the FOC task has to leave time for lower priority work
+    static constexpr std::array<uint32_t, probeCount> m_budgets{
+            m_tickCycles / 2,  // TICK
+            m_tickCycles / 5,  // ENCODER_READ
+            m_tickCycles / 20, // HAPTICS
+            m_tickCycles / 5,  // FOC
+            m_tickCycles / 20, // PWM
+    };
+
+    // Power of two bucket widths so the histograms span twice the budget, overruns stay visible in p99
+    static constexpr std::array<uint32_t, probeCount> m_shifts = [] {
+        std::array<uint32_t, probeCount> shifts{};
+        for (size_t i = 0; i < probeCount; i++) {
+            shifts[i] = std::bit_width(2 * m_budgets[i] / bucketCount);
+        }
+        return shifts;
+    }();
+
+    static constexpr std::array<const char*, probeCount> m_names{"tick", "encoder read", "haptics", "loop_foc", "pwm"};
+
+    std::array<Histogram, probeCount> m_histograms{};
+    std::atomic<bool>                 m_resetRequested{false};
+#else
+    class Scope {
+    public:
+        Scope(LoopProfiler&, Probe) {}
+    };
+#endif
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_LOOPPROFILER_HPP
@@ -1,30 +1,220 @@
 #ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_MOTORDRIVER_HPP
 #define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_MOTORDRIVER_HPP
 
+#include <driver/gptimer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
 #include "Component.hpp"
+#include "CoggingMap.hpp"
+#include "ConfigProvider.hpp"
+#include "HapticProfile.hpp"
+#include "HapticWaveform.hpp"
+#include "LoopProfiler.hpp"
 #include "MagneticEncoder.hpp"
+#include "RelayAutotune.hpp"
 #include "bldc_driver.hpp"
-#include "bldc_haptics.hpp"
 #include "bldc_motor.hpp"
 
-using encoder     = Mt6701_spi;
-using bldcMotor   = espp::BldcMotor<espp::BldcDriver, encoder>;
-using BldcHaptics = espp::BldcHaptics<bldcMotor>;
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+#include "PwmSync.hpp"
+#endif
+
+#if defined(CONFIG_MOTOR_DRIVER_LOOP_PROFILER) || defined(CONFIG_MOTOR_DRIVER_PWM_SYNC)
+/**
+ * @brief BldcDriver that instruments PWM updates, BldcMotor calls set_voltage() on its driver type directly
+ *
+ * Only updates from the FOC task are timed. Calibration, open loop alignment and motor setup drive the
+ * PWM from other tasks, and the profiler's counters must only ever have a single writer. Every update,
+ * whichever task makes it, hands the phase A duty cycle to PwmSync, which places the pulse midpoint by it.
+ */
+class InstrumentedBldcDriver final : public espp::BldcDriver {
+public:
+    InstrumentedBldcDriver(const Config& config, LoopProfiler& profiler, const std::atomic<TaskHandle_t>& focTask)
+        : BldcDriver(config), m_supplyVoltage(config.power_supply_voltage), m_profiler(profiler), m_focTask(focTask) {}
+
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    void setPwmSync(PwmSync* pwmSync) { m_pwmSync = pwmSync; }
+#endif
+
+    void set_voltage(const float ua, const float ub, const float uc) {
+        if (xTaskGetCurrentTaskHandle() != m_focTask.load(std::memory_order_relaxed)) {
+            BldcDriver::set_voltage(ua, ub, uc);
+        } else {
+            LoopProfiler::Scope probe(m_profiler, LoopProfiler::Probe::PWM);
+            BldcDriver::set_voltage(ua, ub, uc);
+        }
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+        if (m_pwmSync != nullptr) {
+            m_pwmSync->setDuty(ua / m_supplyVoltage);
+        }
+#endif
+    }
+
+private:
+    float                            m_supplyVoltage;
+    LoopProfiler&                    m_profiler;
+    const std::atomic<TaskHandle_t>& m_focTask;
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    PwmSync* m_pwmSync = nullptr;
+#endif
+};
+
+using bldcDriver = InstrumentedBldcDriver;
+#else
+using bldcDriver = espp::BldcDriver;
+#endif
+
+using encoder   = Mt6701_spi;
+using bldcMotor = espp::BldcMotor<bldcDriver, encoder>;
 
 class MotorDriver final : public sdk::Component {
 public:
+    /**
+     * @brief Electrical calibration measured on first boot, reused as long as it passes a sanity check,
+     *        and PID gains found by autotune(), 0 gains mean the defaults are used
+     */
+    class Config final : public sdk::ConfigObject<9, 512, "Motor driver"> {
+        using Base = ConfigObject;
+
+    public:
+        sdk::ConfigField<float>   zeroElectricOffset{0.0f, "zeroElectricOffset"};
+        sdk::ConfigField<int32_t> sensorDirection{0, "sensorDirection"};
+        sdk::ConfigField<int32_t> alignmentDurationMs{0, "alignmentDurationMs"};
+        sdk::ConfigField<float>   velocityKp{0.0f, "velocityKp"};
+        sdk::ConfigField<float>   velocityKi{0.0f, "velocityKi"};
+        sdk::ConfigField<float>   velocityKd{0.0f, "velocityKd"};
+        sdk::ConfigField<float>   angleKp{0.0f, "angleKp"};
+        sdk::ConfigField<float>   angleKi{0.0f, "angleKi"};
+        sdk::ConfigField<float>   angleKd{0.0f, "angleKd"};
+
+        void allocateFields() {
+            zeroElectricOffset  = allocate(zeroElectricOffset);
+            sensorDirection     = allocate(sensorDirection);
+            alignmentDurationMs = allocate(alignmentDurationMs);
+            velocityKp          = allocate(velocityKp);
+            velocityKi          = allocate(velocityKi);
+            velocityKd          = allocate(velocityKd);
+            angleKp             = allocate(angleKp);
+            angleKi             = allocate(angleKi);
+            angleKd             = allocate(angleKd);
+        }
+
+        explicit Config(const nlohmann::json& data) : Base(data) {
+            allocateFields();
+        }
+
+        Config() {
+            allocateFields();
+        }
+
+        void updateField(const sdk::ConfigField<float>& field, const float& newValue) { Base::updateField(field, newValue); }
+        void updateField(const sdk::ConfigField<int32_t>& field, const int32_t& newValue) { Base::updateField(field, newValue); }
+    };
+
+    /**
+     * @brief Cogging feed-forward table measured by calibrateCogging(), in its own config object as it is
+     *        much larger than the rest of the calibration
+     */
+    class CoggingConfig final : public sdk::ConfigObject<1, 4096, "Cogging map"> {
+        using Base = ConfigObject;
+
+    public:
+        sdk::ConfigField<CoggingMap::Table> table{{}, "table"};
+
+        void allocateFields() {
+            table = allocate(table);
+        }
+
+        explicit CoggingConfig(const nlohmann::json& data) : Base(data) {
+            allocateFields();
+        }
+
+        CoggingConfig() {
+            allocateFields();
+        }
+
+        void updateField(const sdk::ConfigField<CoggingMap::Table>& field, const CoggingMap::Table& newValue) { Base::updateField(field, newValue); }
+    };
+
+    /**
+     * @brief Timing of the FOC loop, periods are measured between consecutive ticks
+     */
+    struct LoopStats {
+        uint32_t iterations;
+        uint32_t minPeriodUs;
+        uint32_t maxPeriodUs;
+        float    meanPeriodUs;
+    };
+
+    /**
+     * @brief Idle policy state, wake latency is measured from the last idle sample that saw the shaft
+     *        still to the first full-rate tick
+     */
+    struct IdleStats {
+        bool     idle;
+        uint32_t entries;
+        uint32_t lastWakeLatencyUs;
+        uint32_t maxWakeLatencyUs;
+        uint32_t idleTimeMs; ///< Total of finished idle periods
+    };
+
     MotorDriver() = default;
+    ~MotorDriver();
 
     /**
     * @brief Set the magnetic encoder, needed for the haptics to know the shaft angle
-    * @param magnetic_encoder Mt6701_spi encoder
+    * @param magneticEncoder Running magnetic encoder, the FOC task takes over sampling it
+    * @return esp_err_t on error
+    * @note Required before initialize(), which fails with ESP_ERR_INVALID_STATE without a sensor
     */
-    void setSensor(const std::shared_ptr<encoder>& magnetic_encoder);
+    std::error_code setSensor(MagneticEncoder& magneticEncoder);
 
     /**
-    * @brief Returns the motor 0 degrees, takes a while and is currently unused
-    */
-    void setZero() const;
+     * @brief Progress of homing, see startHoming()
+     */
+    enum class HomingState : uint8_t {
+        IDLE,      ///< Never started
+        PENDING,   ///< Requested, picked up on the next FOC tick
+        MOVING,    ///< Setpoint ramping towards zero
+        SETTLING,  ///< Setpoint at zero, waiting for the shaft to come to rest
+        DONE,      ///< Shaft at zero, haptics resumed
+        TIMED_OUT, ///< Gave up, haptics resumed wherever the shaft is
+        ABORTED,   ///< Stopped by abortHoming(), haptics resumed wherever the shaft is
+    };
+
+    struct HomingStatus {
+        HomingState state;
+        float       progress; ///< 0 at the start, 1 with the shaft at zero
+    };
+
+    using HomingCallback = std::function<void(HomingState)>;
+
+    /**
+     * @brief Drives the shaft back to its zero angle, one step per FOC tick, returns immediately
+     * @param timeoutMs Time after which homing gives up with TIMED_OUT
+     * @param onFinished Called with the final state from run(), on the component manager's task, never
+     *                   from the FOC task. Callers can also poll getHomingStatus() instead.
+     * @return ESP_ERR_INVALID_STATE when the driver is not running, already homing or the previous result
+     *         was not delivered yet
+     * @note Haptics are paused while homing and resume, centered on the shaft, when it ends. The shaft is
+     *       moved by BldcMotor's angle and velocity loops, with the gains found by autotune() if any.
+     */
+    std::error_code startHoming(uint32_t timeoutMs = m_defaultHomingTimeoutMs, HomingCallback onFinished = {});
+
+    /**
+     * @brief Stops homing on the next FOC tick, does nothing when not homing
+     */
+    void abortHoming() { m_homingAbort.store(true, std::memory_order_relaxed); }
+
+    HomingStatus getHomingStatus() const {
+        return {m_homingState.load(std::memory_order_acquire), m_homingProgress.load(std::memory_order_relaxed)};
+    }
 
 
     /* Component override functions */
@@ -35,31 +225,395 @@ public:
     Status stop() override;
 
     /**
-     * @brief Sets detent config
+     * @brief Sets detent config, baked into a haptic profile
      * @param config Type of haptic feedback
      * @param position Position within the DetentConfig, gets
      *                 clamped to `config.min_position` and `config.max_position`
+     * @param fadeTicks FOC ticks over which torque cross-fades from the previous profile, 0 switches at once
+     */
+    void setDetentConfig(const espp::detail::DetentConfig& config, int position,
+                         uint32_t fadeTicks = CONFIG_MOTOR_DRIVER_PROFILE_FADE_TICKS);
+
+    /**
+     * @brief Activates a haptic profile, centered on the current shaft angle
+     * @param profile Profile to activate, owned by the motor driver from here on
+     * @param position Position to start at, gets clamped to the positions of a bounded profile
+     * @param fadeTicks FOC ticks over which torque cross-fades from the previous profile, 0 switches at once.
+     *                  Strength, spacing, end stops and damping all blend, the motor stays energised.
+     * @note Returns at once. The profile is queued and the FOC task adopts it once a fade still in progress
+     *       ended, a profile queued before it was adopted is replaced and freed here. Profiles the FOC task
+     *       is done with are freed by run().
      */
-    void setDetentConfig(const espp::detail::DetentConfig& config, int position) const;
+    void setHapticProfile(std::unique_ptr<HapticProfile> profile, int position,
+                          uint32_t fadeTicks = CONFIG_MOTOR_DRIVER_PROFILE_FADE_TICKS);
+
+    /**
+     * @brief Plays a short torque effect on top of the haptic profile, mixed in from the next FOC tick on
+     * @param effect Waveform to play
+     * @param amplitude Volts at full scale of the waveform, negative flips its direction
+     * @return False when the trigger queue is full
+     * @note Never blocks. A trigger wakes the motor from idle, at most one idle period late.
+     */
+    bool playWaveform(hapticWaveform::Effect effect, float amplitude = m_defaultWaveformAmplitude) {
+        const WaveformPlayer::Trigger trigger{effect, amplitude};
+        return xQueueSend(m_waveformQueue, &trigger, 0) == pdTRUE;
+    }
+
+    /**
+     * @brief playWaveform() for interrupt handlers
+     * @param higherPriorityTaskWoken Set when the handler should yield on return, see xQueueSendFromISR()
+     */
+    bool IRAM_ATTR playWaveformFromISR(const hapticWaveform::Effect effect, const float amplitude, BaseType_t* higherPriorityTaskWoken) {
+        const WaveformPlayer::Trigger trigger{effect, amplitude};
+        return xQueueSendFromISR(m_waveformQueue, &trigger, higherPriorityTaskWoken) == pdTRUE;
+    }
 
     /**
     * @brief Returns haptic position within the current haptic config
     */
-    float getPosition() const { return m_haptics->get_position(); };
+    float getPosition() const { return static_cast<float>(m_position.load(std::memory_order_relaxed)); };
+
+    /**
+     * @brief Spins the motor open-loop over one revolution in both directions and saves the
+     *        measured encoder nonlinearity as a correction table, blocks for a few seconds
+     * @note The knob must be free to rotate and untouched while calibrating
+     * @return esp_err_t on error
+     */
+    std::error_code calibrateEncoderLinearity();
+
+    /**
+     * @brief Whether no cogging map has been calibrated yet
+     */
+    bool needsCoggingCalibration() { return m_coggingConfig.isDefault(); }
+
+    /**
+     * @brief Sweeps the shaft slowly through one revolution and back in closed-loop angle control and saves
+     *        the holding effort per angle as a cogging feed-forward table, blocks for about 15 seconds
+     * @note The knob must be free to rotate and untouched while calibrating. The table is added to the
+     *       haptic torque command from then on.
+     * @return ESP_ERR_INVALID_STATE when not running, homing or autotuning, ESP_ERR_INVALID_SIZE when the
+     *         sweep missed part of the revolution, esp_err_t when saving failed
+     */
+    std::error_code calibrateCogging();
+
+    /**
+     * @brief Identifies the motor and knob with a relay experiment and saves velocity and angle PID gains
+     *        placed for a target settling time of the angle loop, blocks for a few seconds
+     * @note The knob must be free to rotate and untouched. Gains are loaded when the motor is created at
+     *       initialization, so they take effect after a restart. Homing is what runs on these loops.
+     * @return ESP_ERR_INVALID_STATE when not running, homing or calibrating cogging, ESP_ERR_INVALID_RESPONSE when the knob did
+     *         not oscillate as expected, ESP_ERR_INVALID_ARG when the target is so slow the velocity loop would need no
+     *         proportional gain, esp_err_t when saving failed
+     */
+    std::error_code autotune(uint32_t targetSettlingMs = m_defaultAutotuneSettlingMs);
+
+    /**
+     * @brief Returns FOC loop period statistics since the last reset
+     */
+    LoopStats getLoopStats() const;
+
+    /**
+     * @brief Resets FOC loop period statistics, applied by the FOC task on its next tick
+     */
+    void resetLoopStats() { m_resetLoopStats.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @brief Whether the FOC loop dropped to its idle rate, see CONFIG_MOTOR_DRIVER_IDLE_TIMEOUT_MS
+     */
+    bool isIdle() const { return m_idle.load(std::memory_order_relaxed); }
+
+    IdleStats getIdleStats() const;
+
+    /**
+     * @brief Counts as user input for the idle policy, e.g. a press on the strain sensor. Shaft motion
+     *        is detected by the FOC task itself.
+     */
+    void notifyActivity() { m_activity.store(true, std::memory_order_relaxed); }
+
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    /**
+     * @brief How often the FOC tick landed on a PWM pulse midpoint, the encoder sample to PWM update latency
+     *        and the CPU load of the capture interrupt
+     */
+    PwmSync::Stats getPwmSyncStats() const { return m_pwmSync.stats(); }
+#endif
+
+#ifdef CONFIG_MOTOR_DRIVER_LOOP_PROFILER
+    /**
+     * @brief Cycle count percentiles of the FOC loop stages since the last reset
+     */
+    LoopProfiler::Snapshot getLoopProfile() const { return m_profiler.snapshot(); }
+
+    /**
+     * @brief Clears the FOC loop stage histograms, applied by the FOC task on its next tick
+     */
+    void resetLoopProfile() { m_profiler.reset(); }
+#endif
 
 private:
     static const inline char TAG[] = "Motor driver";
 
+    // Voltage used to pull the rotor to an open-loop angle, ~0.5A through the phase resistance
+    static constexpr float m_alignVoltage = 2.0f;
+    // Largest electrical offset error (radians) for which a saved calibration is still reused
+    static constexpr float m_electricalCalibrationTolerance = 0.35f;
+    // Least part of the commanded electrical revolution the shaft must follow while measuring the direction
+    static constexpr float m_minAlignmentMovement = 0.5f;
+    // Above this velocity (rad/s) haptic torque is cut, so a flicked knob is not fought
+    static constexpr float m_maxHapticVelocity = 60.0f;
+    // Homing ramps its setpoint towards zero at this speed (rad/s), BldcMotor's angle loop follows it
+    static constexpr uint32_t m_defaultHomingTimeoutMs = 5000;
+    static constexpr float    m_homingSpeed            = 3.0f;
+    // Shaft counts as home within this angle (rad) and below this speed (rad/s) for a tenth of a second
+    static constexpr float    m_homingTolerance        = 1.0f * fastMath::degreesToRadians;
+    static constexpr float    m_homingSettleSpeed      = 0.5f;
+    static constexpr uint32_t m_homingSettleTicks      = CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY / 10;
+    // Relay command (move() units) and hysteresis of the autotune experiment, and its length
+    static constexpr uint32_t m_defaultAutotuneSettlingMs = 80;
+    static constexpr float    m_autotuneRelayOutput       = 0.25f;
+    static constexpr float    m_autotuneHysteresis        = 1.0f * fastMath::degreesToRadians;
+    static constexpr uint32_t m_autotuneTicks             = 2 * CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+    // Waveform amplitude when none is given, and the number of triggers that can wait for the FOC task
+    static constexpr float  m_defaultWaveformAmplitude = 2.0f;
+    static constexpr size_t m_waveformQueueLength      = 8;
+    // Cogging sweep: setpoint speed (rad/s), overlap past a full revolution (rad) and a stiff PID angle hold
+    static constexpr float    m_coggingSweepSpeed   = 1.0f;
+    static constexpr float    m_coggingSweepOverlap = 10.0f * fastMath::degreesToRadians;
+    static constexpr float    m_coggingKp           = 10.0f;  // V/rad
+    static constexpr float    m_coggingKi           = 400.0f; // V/(rad s)
+    static constexpr float    m_coggingKd           = 0.05f;  // V/(rad/s)
+    static constexpr float    m_coggingVoltageLimit = 2.5f;
+    static constexpr uint32_t m_coggingSettleTicks  = CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY / 4;
+    static constexpr uint32_t m_coggingSweepTicks   = static_cast<uint32_t>((fastMath::tau + m_coggingSweepOverlap) / m_coggingSweepSpeed *
+                                                                        CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY);
+    // Steps per mechanical revolution during linearity calibration
+    static constexpr int m_linearityCalibrationSteps = 512;
+
+    static constexpr uint32_t m_focTimerResolutionHz = 1000 * 1000;
+    static constexpr uint32_t m_focLoopPeriodTicks   = m_focTimerResolutionHz / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+    static constexpr uint32_t m_idleLoopPeriodTicks  = m_focTimerResolutionHz / CONFIG_MOTOR_DRIVER_IDLE_LOOP_FREQUENCY;
+    static constexpr int64_t  m_idleTimeoutUs        = static_cast<int64_t>(CONFIG_MOTOR_DRIVER_IDLE_TIMEOUT_MS) * 1000;
+    // Shaft motion beyond this angle (rad) counts as activity, well above encoder noise
+    static constexpr float    m_idleMotionThreshold = 0.5f * fastMath::degreesToRadians;
+
+    static bool IRAM_ATTR onFocTimer(gptimer_handle_t timer, const gptimer_alarm_event_data_t* eventData, void* _this);
+
     /**
-    * @brief Sets the motor control type, also disables de motor momentarily
-    * @param motionControlType Desired control method for the motor
-    */
-    void updateMotionControlType(espp::detail::MotionControlType motionControlType) const;
+     * @brief Entry point of the FOC task, sets up the FOC timer on the task's own core
+     */
+    static void startFocTask(void* _this);
+    void        focTask();
+
+    /**
+     * @brief Single control tick: encoder sample, haptics update and loop_foc()
+     */
+    void focStep();
+
+    /**
+     * @brief Advances a fade, or adopts a queued haptic profile when none is in progress, called by the
+     *        FOC task every tick
+     */
+    void updateProfile();
+
+    /**
+     * @brief Torque command from the active haptic profile, cross-faded from the previous one while a
+     *        fade is in progress, only called by the FOC task
+     */
+    float hapticTorque();
+
+    /**
+     * @brief Starts triggered waveforms and advances the playing ones, only called by the FOC task
+     * @return Waveform command for this tick, volts
+     */
+    float waveformCommand();
+
+    /**
+     * @brief Recenters the active profile on the shaft on the next haptics update and drops a fade in
+     *        progress, for when something else moved the shaft. Only called by the FOC task.
+     */
+    void recenterProfile();
+
+    /**
+     * @brief Advances homing by one tick, only called by the FOC task
+     * @return True when homing set this tick's torque command
+     */
+    bool homingStep();
+
+    /**
+     * @brief Publishes the final state, the FOC task never logs or calls the callback itself
+     */
+    void finishHoming(HomingState state);
+
+    /**
+     * @brief Logs a finished homing and calls its callback, from run()
+     */
+    void reportHoming();
+
+    /**
+     * @brief Advances the autotune experiment by one tick, only called by the FOC task
+     * @return True when autotune set this tick's torque command
+     */
+    bool autotuneStep();
 
+    /**
+     * @brief Advances the cogging sweep by one tick, only called by the FOC task
+     * @return True when the sweep set this tick's torque command
+     */
+    bool coggingStep();
+
+    /**
+     * @brief Replaces the default PID gains in the motor config with the saved autotune gains, if any
+     */
+    void applyTunedGains();
+
+    void updateLoopStats(int64_t now);
+
+    /**
+     * @brief Applies the idle policy, only called by the FOC task
+     * @return Whether the motor is driven this tick
+     */
+    bool updateIdle(int64_t now);
+    void enterIdle(int64_t now);
+    void exitIdle(int64_t now);
+    void setFocTimerPeriod(uint32_t ticks) const;
+
+    /**
+     * @brief Fills in zero_electric_offset and sensor_direction of m_motorConfig, from config when
+     *        the saved values pass verifyElectricalCalibration(), otherwise by measuring and saving them
+     */
+    void setupElectricalCalibration();
+
+    /**
+     * @brief Fast check of a saved calibration: one alignment to electrical zero and a quarter turn step
+     * @return True when the offset is within tolerance and the shaft moves in the saved direction
+     */
+    bool verifyElectricalCalibration(float offset, espp::detail::SensorDirection direction) const;
+
+    /**
+     * @brief Sweeps one electrical revolution forward and back
+     * @return SensorDirection::UNKNOWN when the shaft did not follow, stuck or unpowered
+     */
+    espp::detail::SensorDirection measureSensorDirection() const;
+    float                         measureZeroElectricOffset(espp::detail::SensorDirection direction) const;
+
+    /**
+     * @brief Electrical angle of a shaft angle, in [0, 2pi), without any offset applied
+     */
+    float electricalAngle(float shaftAngle, espp::detail::SensorDirection direction) const;
+
+    /**
+     * @brief Pulls the rotor to an electrical angle open-loop and lets it settle
+     * @return Shaft angle after settling
+     */
+    float holdOpenLoop(float electricalAngle, TickType_t settleTicks) const;
+
+    /**
+     * @brief Drives a fixed voltage vector, bypassing loop_foc(), used for open-loop calibration
+     * @param voltage Vector magnitude in volts
+     * @param electricalAngle Electrical angle of the vector in radians
+     */
+    void setOpenLoopVector(float voltage, float electricalAngle) const;
+
+    std::error_code startFocTimer();
+    void            stopFocTimer();
+
+    Config                            m_config;
+    CoggingConfig                     m_coggingConfig;
+    CoggingMap                        m_cogging;
+    MagneticEncoder*                  m_magneticEncoder = nullptr;
     std::shared_ptr<encoder>          m_encoder;
-    std::shared_ptr<espp::BldcDriver> m_driver;
+    std::shared_ptr<bldcDriver>       m_driver;
     std::shared_ptr<bldcMotor>        m_motor;
-    std::unique_ptr<BldcHaptics>      m_haptics;
+    LoopProfiler                      m_profiler;
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    PwmSync                           m_pwmSync;
+#endif
+
+    gptimer_handle_t          m_focTimer = nullptr;
+    std::atomic<TaskHandle_t> m_focTaskHandle{nullptr};
+    std::atomic<bool>         m_run{false};
+    std::atomic<bool>         m_focLoopRunning{false};
+    std::atomic<esp_err_t>    m_focTaskError{ESP_OK}; ///< Set by the FOC task when it could not start its loop
+    std::atomic<bool>         m_motorReady{false};
+
+    struct QueuedProfile {
+        std::unique_ptr<HapticProfile> profile;
+        uint32_t                       fadeTicks;
+    };
+
+    // Haptic profiles are handed to the FOC task through a pending slot, which it empties once no fade
+    // is in progress, and handed back through a retired slot run() frees, so neither side waits and the
+    // FOC task never frees memory. Every adopted profile retires exactly one, right away or once its fade
+    // ended, and the FOC task only adopts while the retired slot is empty, so one slot is enough.
+    std::atomic<QueuedProfile*>    m_pendingProfile{nullptr};
+    std::atomic<QueuedProfile*>    m_retiredProfile{nullptr};
+    std::atomic<bool>              m_hapticsEnabled{false};
+    std::atomic<int>               m_position{0};
+
+    // Only used by the FOC task
+    std::unique_ptr<QueuedProfile> m_activeProfile;
+    bool                           m_recenter      = true;
+    float                          m_profileOrigin = 0.0f;
+    std::unique_ptr<QueuedProfile> m_fadeFrom;
+    float                          m_fadeOrigin    = 0.0f;
+    uint32_t                       m_fadeLength    = 0;
+    uint32_t                       m_fadeTicksLeft = 0;
+
+    // Waveform triggers from any task or interrupt, drained by the FOC task every tick
+    StaticQueue_t                                                                 m_waveformQueueBuffer{};
+    std::array<uint8_t, m_waveformQueueLength * sizeof(WaveformPlayer::Trigger)> m_waveformQueueStorage{};
+    QueueHandle_t  m_waveformQueue = xQueueCreateStatic(m_waveformQueueLength, sizeof(WaveformPlayer::Trigger),
+                                                        m_waveformQueueStorage.data(), &m_waveformQueueBuffer);
+    WaveformPlayer m_waveformPlayer;
+
+    // Homing request and progress, the callback and timeout are written before PENDING is published
+    std::atomic<HomingState> m_homingState{HomingState::IDLE};
+    std::atomic<float>       m_homingProgress{0.0f};
+    std::atomic<bool>        m_homingAbort{false};
+    HomingCallback           m_homingCallback;
+    uint32_t                 m_homingTimeoutMs = 0;
+    // Set by the FOC task before it publishes the final state, cleared by run() once it was reported
+    std::atomic<bool>        m_homingResultPending{false};
+    std::atomic<float>       m_homingFinalAngle{0.0f};
+
+    // Written by autotune() before setting the flag, then only by the FOC task until it clears it
+    RelayAutotune     m_autotune{m_autotuneRelayOutput, m_autotuneHysteresis, 1.0f / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY};
+    std::atomic<bool> m_autotuneRunning{false};
+
+    // Written by calibrateCogging() before setting the flag, then only by the FOC task until it clears it
+    std::unique_ptr<CoggingMap::Recorder> m_coggingRecorder;
+    std::atomic<bool>                     m_coggingRunning{false};
+    uint32_t                              m_coggingTicks    = 0;
+    float                                 m_coggingStart    = 0.0f;
+    float                                 m_coggingIntegral = 0.0f;
+
+    // Homing state only used by the FOC task
+    float    m_homingStartAngle   = 0.0f;
+    float    m_homingSetpoint     = 0.0f;
+    int64_t  m_homingDeadlineUs   = 0;
+    uint32_t m_homingSettledTicks = 0;
+
+    // Idle policy, the atomics are written by the FOC task only
+    std::atomic<bool>     m_activity{false};
+    std::atomic<bool>     m_idle{false};
+    std::atomic<uint32_t> m_idleEntries{0};
+    std::atomic<uint32_t> m_lastWakeLatencyUs{0};
+    std::atomic<uint32_t> m_maxWakeLatencyUs{0};
+    std::atomic<uint32_t> m_idleTimeMs{0};
+    float                 m_idleReferenceAngle = 0.0f;
+    int64_t               m_lastActivityUs     = 0;
+    int64_t               m_idleSinceUs        = 0;
+    int64_t               m_lastIdleSampleUs   = 0;
+    int64_t               m_wakeStartUs        = 0;
+
+    // Only written by the FOC task
+    int64_t               m_lastTickUs  = 0;
+    uint64_t              m_periodSumUs = 0;
+    std::atomic<uint32_t> m_loopIterations{0};
+    std::atomic<uint32_t> m_minPeriodUs{UINT32_MAX};
+    std::atomic<uint32_t> m_maxPeriodUs{0};
+    std::atomic<float>    m_meanPeriodUs{0.0f};
+    std::atomic<bool>     m_resetLoopStats{false};
 
     constexpr static espp::BldcDriver::Config m_driverConfig{
             .gpio_a_h             = 9,
@@ -84,13 +638,13 @@ private:
             .kv_rating =
                     270,                 // tested by running velocity_openloop and seeing if the velocity is ~correct
             .current_limit        = 1.5f, // Amps
-            .zero_electric_offset = 0.0f, // set to zero to always calibrate, since this is a test
+            .zero_electric_offset = 0.0f, // filled in by setupElectricalCalibration()
             .sensor_direction =
-                    espp::detail::SensorDirection::UNKNOWN, // set to unknown to always calibrate
+                    espp::detail::SensorDirection::UNKNOWN, // filled in by setupElectricalCalibration()
             .foc_type          = espp::detail::FocType::SPACE_VECTOR_PWM,
             .driver            = {},
             .sensor            = {},
-            .run_sensor_update = true,
+            .run_sensor_update = false, // the FOC task samples the encoder once per tick
             .velocity_pid_config =
                     {
                             .kp             = 0.010f,
@@ -114,12 +668,6 @@ private:
             .auto_init = false,
             .log_level = espp::Logger::Verbosity::NONE};
 
-    BldcHaptics::Config m_hapticsConfig{
-            .motor         = *m_motor.get(),
-            .kp_factor     = 2,
-            .kd_factor_min = 0.01,
-            .kd_factor_max = 0.04,
-            .log_level     = espp::Logger::Verbosity::NONE};
 };
 
 #endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_MOTORDRIVER_HPP
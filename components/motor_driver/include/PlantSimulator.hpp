@@ -0,0 +1,99 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_PLANTSIMULATOR_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_PLANTSIMULATOR_HPP
+
+#include <cstdint>
+
+#include "FastMath.hpp"
+
+/**
+ * @brief Simulated gimbal motor, knob and MT6701, driven by the same voltage commands as the real motor
+ *
+ * Models rotor plus knob inertia, viscous and Coulomb (stick-slip) friction, cogging, back EMF and the
+ * voltage to torque path of a voltage controlled BLDC, and quantises the shaft angle to encoder counts
+ * with a little noise. Plain C++ without ESP-IDF dependencies, test/host runs the haptics code against it.
+ *
+ * Angles and torques are counter-clockwise positive, like the shaft angle of espp::BldcMotor.
+ */
+class PlantSimulator {
+public:
+    struct Config {
+        float    inertia         = 1.6e-5f; ///< kg m^2, a 50 g aluminium knob dominates the rotor
+        float    torqueConstant  = 6e-3f;   ///< Nm per volt of q-axis command, lumps Kt / R
+        float    backEmf         = 0.09f;   ///< V per rad/s, a ~100 KV gimbal motor
+        float    viscousFriction = 2e-5f;   ///< Nm per rad/s
+        float    coulombFriction = 5e-5f;   ///< Nm, bearings and the knob's felt washer
+        float    coggingTorque   = 5e-5f;   ///< Nm amplitude
+        uint32_t coggingPeriods  = 42;      ///< Cogging cycles per revolution, LCM of slots and poles
+        uint32_t encoderCounts   = 16384;   ///< MT6701 resolution over SSI
+        float    encoderNoise    = 1.0f;    ///< Peak noise in counts
+    };
+
+    explicit PlantSimulator(const Config& config) : m_config(config) {}
+
+    /**
+     * @brief Places the shaft at rest, e.g. where the user let go of the knob
+     */
+    void reset(const float angle) {
+        m_angle    = angle;
+        m_velocity = 0.0f;
+    }
+
+    /**
+     * @brief Advances the plant by one control period with a constant voltage command
+     * @param voltage Torque command as passed to BldcMotor::move(), counter-clockwise positive
+     * @param dt Control period in seconds
+     */
+    void step(const float voltage, const float dt) {
+        const float drive = m_config.torqueConstant * (voltage - m_config.backEmf * m_velocity)
+                            - m_config.coggingTorque * fastMath::sin(static_cast<float>(m_config.coggingPeriods) * m_angle)
+                            - m_config.viscousFriction * m_velocity;
+
+        // Static friction holds the shaft until the drive torque breaks it loose
+        if (m_velocity == 0.0f && fastMath::abs(drive) <= m_config.coulombFriction) {
+            return;
+        }
+
+        const float direction = m_velocity != 0.0f ? m_velocity : drive;
+        const float friction  = direction > 0.0f ? m_config.coulombFriction : -m_config.coulombFriction;
+        float       velocity  = m_velocity + (drive - friction) / m_config.inertia * dt;
+
+        // Friction can stop the shaft within a step but never reverses it
+        if (m_velocity != 0.0f && (velocity > 0.0f) != (m_velocity > 0.0f)) {
+            velocity = 0.0f;
+        }
+
+        // Semi-implicit Euler, stays stable for the stiff springs of strong detents
+        m_velocity = velocity;
+        m_angle += m_velocity * dt;
+    }
+
+    /**
+     * @brief Multi-turn shaft angle as the encoder reports it, quantised and with noise
+     */
+    float encoderAngle() {
+        const float countsPerRadian = static_cast<float>(m_config.encoderCounts) / fastMath::tau;
+        const float counts          = m_angle * countsPerRadian + m_config.encoderNoise * noise();
+        return fastMath::floor(counts + 0.5f) / countsPerRadian;
+    }
+
+    float angle() const { return m_angle; }
+    float velocity() const { return m_velocity; }
+
+private:
+    /**
+     * @brief Uniform noise in [-1, 1], xorshift32 so runs are repeatable
+     */
+    float noise() {
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 17;
+        m_random ^= m_random << 5;
+        return static_cast<float>(m_random) * (2.0f / 4294967296.0f) - 1.0f;
+    }
+
+    Config   m_config;
+    float    m_angle    = 0.0f;
+    float    m_velocity = 0.0f;
+    uint32_t m_random   = 0x2545f491;
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_PLANTSIMULATOR_HPP
@@ -0,0 +1,118 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_PWMSYNC_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_PWMSYNC_HPP
+
+#include <driver/gptimer.h>
+#include <driver/mcpwm_cap.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <system_error>
+
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief Lines the FOC timer up with the middle of the PWM pulse, so the encoder is sampled away from
+ *        switching edges and at a fixed delay before the next PWM update
+ *
+ * espp::BldcDriver keeps its MCPWM timer to itself, so the PWM phase is recovered from the gate signal:
+ * an MCPWM capture channel timestamps the rising edge of the phase A high side pulse. The pulse is centered
+ * on the PWM period, so its midpoint lies half a pulse width after the rising edge, the width being the
+ * phase A duty cycle the driver last wrote times the measured period. Dead time delays the rising edge, the
+ * midpoint lands half the dead time late. On the rising edge of the PWM period in which the FOC timer is due,
+ * the capture interrupt moves the timer count so its alarm fires at that midpoint. The timer keeps running
+ * on its own period, so the FOC loop carries on unsynced while the driver is disabled and there are no pulses.
+ *
+ * One edge per period means one interrupt per PWM period, half of what timing both edges of the pulse costs.
+ * The interrupt times itself, stats() reports the share of the CPU it takes.
+ *
+ * Latency is measured from the encoder sample to the first rising edge after the new voltages were written,
+ * the first edge the new compare values can move.
+ */
+class PwmSync {
+public:
+    struct Stats {
+        uint32_t syncs;         ///< FOC ticks moved onto a pulse midpoint
+        uint32_t pwmPeriodNs;   ///< Measured between rising edges
+        uint32_t lastLatencyNs; ///< Encoder sample to PWM update
+        uint32_t minLatencyNs;
+        uint32_t maxLatencyNs;
+        uint32_t interrupts;      ///< Capture interrupts, one per PWM period
+        uint32_t meanInterruptNs; ///< Running mean time spent in the capture callback
+        uint32_t maxInterruptNs;
+        uint32_t loadPermille;    ///< CPU share of the capture callback, interrupt entry and exit not included
+    };
+
+    /**
+     * @brief Starts capturing the gate signal, call from the core the FOC timer interrupt runs on
+     * @param gpio High side gate output of one phase, read back through the GPIO input path
+     * @param focTimer Running FOC timer, counting at 1 MHz with an auto-reloading alarm
+     * @param periodTicks Current alarm period of the FOC timer
+     * @return esp_err_t on error
+     */
+    std::error_code start(int gpio, gptimer_handle_t focTimer, uint32_t periodTicks);
+    void            stop();
+
+    /**
+     * @brief Keeps the capture interrupt in step with a changed FOC timer period
+     */
+    void setTimerPeriod(const uint32_t ticks) { m_timerPeriodTicks.store(ticks, std::memory_order_relaxed); }
+
+    /**
+     * @brief Phase A duty cycle of the latest PWM update, safe to call from any task
+     */
+    void setDuty(const float duty) {
+        m_duty.store(static_cast<uint32_t>(std::clamp(duty, 0.0f, 1.0f) * m_dutyOne), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Marks the encoder sample of this tick, only called by the FOC task
+     */
+    void markSample() {
+        m_pwmWritten.store(false, std::memory_order_relaxed);
+        m_sampleCycles = esp_cpu_get_cycle_count();
+    }
+
+    /**
+     * @brief Marks the new PWM voltages of this tick as written, only called by the FOC task
+     */
+    void markPwmWritten() { m_pwmWritten.store(true, std::memory_order_release); }
+
+    Stats stats() const;
+
+private:
+    static bool IRAM_ATTR onCapture(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t* eventData, void* _this);
+    void IRAM_ATTR        onRisingEdge(uint32_t captured, uint32_t now);
+
+    static constexpr uint32_t m_cyclesPerUs = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    // Duty cycles are fixed point, the interrupt stays clear of the FPU
+    static constexpr uint32_t m_dutyShift = 16;
+    static constexpr uint32_t m_dutyOne   = 1 << m_dutyShift;
+    // Weight of a new sample in the running mean of the interrupt time, as a shift
+    static constexpr uint32_t m_meanShift = 4;
+
+    mcpwm_cap_timer_handle_t   m_captureTimer      = nullptr;
+    mcpwm_cap_channel_handle_t m_captureChannel    = nullptr;
+    gptimer_handle_t           m_focTimer          = nullptr;
+    uint32_t                   m_captureTicksPerUs = 1;
+
+    // Only used by the capture interrupt
+    uint32_t m_lastRise = 0;
+
+    std::atomic<uint32_t> m_timerPeriodTicks{0};
+    std::atomic<uint32_t> m_duty{0};
+    std::atomic<bool>     m_pwmWritten{false};
+    uint32_t              m_sampleCycles = 0;
+
+    std::atomic<uint32_t> m_syncs{0};
+    std::atomic<uint32_t> m_pwmPeriodTicks{0};
+    std::atomic<uint32_t> m_lastLatencyCycles{0};
+    std::atomic<uint32_t> m_minLatencyCycles{UINT32_MAX};
+    std::atomic<uint32_t> m_maxLatencyCycles{0};
+    std::atomic<uint32_t> m_interrupts{0};
+    std::atomic<uint32_t> m_meanInterruptCycles{0}; ///< Scaled by 1 << m_meanShift
+    std::atomic<uint32_t> m_maxInterruptCycles{0};
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_PWMSYNC_HPP
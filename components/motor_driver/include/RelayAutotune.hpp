@@ -0,0 +1,96 @@
+#ifndef FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_RELAYAUTOTUNE_HPP
+#define FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_RELAYAUTOTUNE_HPP
+
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <system_error>
+
+/**
+ * @brief Identifies the motor and knob with a relay experiment and derives velocity and angle PID gains
+ *
+ * A relay with hysteresis on the shaft angle makes the knob oscillate around where it started, which
+ * excites the plant without letting it run away. Every tick is fitted, by least squares, to the discrete
+ * model v[k+1] = a v[k] + b u[k] + c sign(v[k]): inertia with damping, torque gain and Coulomb friction.
+ * The same command path as BldcMotor's velocity PID output is used, so gains come out in its units.
+ *
+ * Gains are placed for a target settling time of the angle loop. The velocity loop gets critically damped
+ * poles a few times faster, so the cascade stays separated.
+ */
+class RelayAutotune {
+public:
+    struct Gains {
+        float kp;
+        float ki;
+        float kd;
+    };
+
+    struct Result {
+        Gains velocity;
+        Gains angle;
+        float plantGain;     ///< Velocity change per second per unit of command, 1/J in command units
+        float plantPole;     ///< Damping, 1/s
+        float periodS;       ///< Relay oscillation period, the ultimate period
+        float ultimateGain;  ///< 4d / (pi a), the classic relay estimate
+    };
+
+    /**
+     * @param relayOutput Command magnitude, in BldcMotor::move() units for TORQUE mode
+     * @param hysteresis Angle band in radians around the start angle in which the relay keeps its state
+     * @param dt Tick period in seconds
+     */
+    RelayAutotune(float relayOutput, float hysteresis, float dt);
+
+    /**
+     * @brief Starts a new experiment, the relay oscillates around the angle of the first step
+     */
+    void start();
+
+    /**
+     * @brief Advances the experiment by one tick
+     * @return Command for this tick
+     */
+    float step(float angle, float velocity);
+
+    /**
+     * @brief Fits the model to the samples so far and places gains for the target settling time
+     * @return ESP_ERR_INVALID_RESPONSE when the knob did not oscillate or the fit makes no physical sense,
+     *         e.g. because the knob was held
+     */
+    std::expected<Result, std::error_code> result(float targetSettlingS) const;
+
+    uint32_t ticks() const { return m_ticks; }
+
+private:
+    // The first oscillations are transient, they are left out of the fit
+    static constexpr uint32_t m_warmupCrossings = 2;
+    static constexpr uint32_t m_minCrossings    = 6;
+    // Velocity poles this many times faster than the angle loop
+    static constexpr float m_cascadeSeparation = 4.0f;
+    // Velocity loop bandwidth limit as a fraction of the tick rate, the command lags a tick or two
+    static constexpr float m_maxBandwidthFraction = 0.04f;
+
+    float m_relayOutput;
+    float m_hysteresis;
+    float m_dt;
+
+    float    m_center       = 0.0f;
+    float    m_command      = 0.0f;
+    float    m_lastVelocity = 0.0f;
+    uint32_t m_ticks        = 0;
+
+    // Relay crossings and the angle extremes between them
+    uint32_t m_crossings         = 0;
+    uint32_t m_firstCrossingTick = 0;
+    uint32_t m_lastCrossingTick  = 0;
+    float    m_peak              = 0.0f;
+    double   m_amplitudeSum      = 0.0;
+    uint32_t m_amplitudes        = 0;
+
+    // Least squares normal equations for regressors [v, u, sign(v)]
+    std::array<double, 6> m_xx{};
+    std::array<double, 3> m_xy{};
+    uint32_t              m_samples = 0;
+};
+
+#endif // FIRMWARE_COMPONENTS_MOTOR_DRIVER_INCLUDE_RELAYAUTOTUNE_HPP
@@ -0,0 +1,42 @@
+#include "CoggingMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "esp_system_error.hpp"
+
+void CoggingMap::Recorder::addSample(const uint16_t count, const float effort, const bool returning) {
+    const size_t bin = ((count + (1 << (m_binShift - 1))) & (mt6701Frame::countsPerRevolution - 1)) >> m_binShift;
+    auto&        n   = m_counts[returning][bin];
+    if (n == UINT16_MAX) {
+        return;
+    }
+    m_sums[returning][bin] += effort;
+    n++;
+    m_samples++;
+}
+
+std::expected<CoggingMap::Table, std::error_code> CoggingMap::Recorder::table() const {
+    std::array<float, tableSize> effort{};
+    float                        mean = 0.0f;
+    for (size_t i = 0; i < tableSize; i++) {
+        if (m_counts[0][i] == 0 || m_counts[1][i] == 0) {
+            return std::unexpected(std::make_error_code(ESP_ERR_INVALID_SIZE));
+        }
+        effort[i] = 0.5f * (m_sums[0][i] / m_counts[0][i] + m_sums[1][i] / m_counts[1][i]);
+        mean += effort[i] / tableSize;
+    }
+
+    Table table{};
+    for (size_t i = 0; i < tableSize; i++) {
+        const float millivolts = std::round((effort[i] - mean) * 1000.0f);
+        table[i] = static_cast<int16_t>(std::clamp(millivolts, static_cast<float>(INT16_MIN), static_cast<float>(INT16_MAX)));
+    }
+    return table;
+}
+
+void CoggingMap::load(const Table& table) {
+    std::copy(table.begin(), table.end(), m_table.begin());
+    m_table[tableSize] = table[0];
+    m_active.store(true, std::memory_order_release);
+}
@@ -0,0 +1,295 @@
+#include "HapticProfile.hpp"
+
+#include <cmath>
+#include <fstream>
+
+#include "esp_system_error.hpp"
+
+// Dead zone around a detent center in which no torque is applied, avoids buzzing
+static constexpr float deadZoneDetentPercent = 0.2f;
+static constexpr float deadZoneMaxRadians    = 1.0f * fastMath::degreesToRadians;
+
+// Derivative factors for narrow and wide detents, interpolated between the two widths
+static constexpr float kdFactorMin          = 0.01f;
+static constexpr float kdFactorMax          = 0.04f;
+static constexpr float derivativeWidthLower = 3.0f * fastMath::degreesToRadians;
+static constexpr float derivativeWidthUpper = 8.0f * fastMath::degreesToRadians;
+
+// Snap bias may not move a boundary closer than this fraction of a detent to the next center
+static constexpr float maxBoundaryFraction = 0.9f;
+
+HapticProfile::Builder& HapticProfile::Builder::position(const float center) {
+    m_positions.push_back(center);
+    return *this;
+}
+
+HapticProfile::Builder& HapticProfile::Builder::detent(const float center, const float before, const float after, const float strength) {
+    m_features.push_back({Feature::Type::DETENT, center, before, after, strength});
+    return position(center);
+}
+
+HapticProfile::Builder& HapticProfile::Builder::notch(const float center, const float width, const float strength) {
+    m_features.push_back({Feature::Type::NOTCH, center, width / 2.0f, width / 2.0f, strength});
+    return *this;
+}
+
+HapticProfile::Builder& HapticProfile::Builder::snap(const float center, const float width, const float strength) {
+    m_features.push_back({Feature::Type::SNAP, center, width / 2.0f, width / 2.0f, strength});
+    return position(center);
+}
+
+HapticProfile::Builder& HapticProfile::Builder::boundary(const size_t after, const float offset) {
+    m_boundaryOverrides.emplace_back(after, offset);
+    return *this;
+}
+
+float HapticProfile::Builder::featureTorque(const Feature& feature, const float distance) {
+    const float gain = feature.strength * kpFactor;
+    const float edge = distance < 0.0f ? feature.before : feature.after;
+    switch (feature.type) {
+        case Feature::Type::DETENT: {
+            const float deadZone = std::min((feature.before + feature.after) * deadZoneDetentPercent, deadZoneMaxRadians);
+            return gain * (-distance + std::clamp(distance, -deadZone, deadZone));
+        }
+        case Feature::Type::NOTCH:
+            // Pushes away from the center, zero at the center and at the edges
+            return gain * distance * (1.0f - (distance / edge) * (distance / edge));
+        case Feature::Type::SNAP: {
+            // Linear pull near the center, fading out quadratically towards the edges
+            const float fade = 1.0f - std::fabs(distance) / edge;
+            return -gain * distance * fade * fade;
+        }
+    }
+    return 0.0f;
+}
+
+std::unique_ptr<HapticProfile> HapticProfile::Builder::build() const {
+    std::unique_ptr<HapticProfile> profile{new HapticProfile()};
+
+    const float range     = m_end - m_start;
+    float       narrowest = range;
+    for (const auto& feature: m_features) {
+        narrowest = std::min(narrowest, feature.before + feature.after);
+    }
+    const auto samples = std::clamp(static_cast<size_t>(std::ceil(range / narrowest * m_samplesPerFeatureWidth)) + 1,
+                                    m_minSamples, m_maxSamples);
+
+    profile->m_start            = m_start;
+    profile->m_period           = range;
+    profile->m_lastSample       = static_cast<float>(samples - 1);
+    profile->m_samplesPerRadian = profile->m_lastSample / range;
+    profile->m_periodic         = m_periodic;
+    profile->m_endStrength      = m_endStrength * kpFactor;
+    profile->m_damping          = m_damping;
+    profile->m_firstPosition    = m_firstPosition;
+
+    // Each feature only touches the samples it spans, so building stays fast for hundreds of detents
+    auto& table = profile->m_table;
+    table.assign(samples, 0.0f);
+    for (const auto& feature: m_features) {
+        for (const float shift: {-range, 0.0f, range}) {
+            if (shift != 0.0f && !m_periodic) {
+                continue;
+            }
+            const float center = feature.center + shift;
+            const auto  first  = std::max(0.0f, std::ceil((center - feature.before - m_start) * profile->m_samplesPerRadian));
+            const auto  last   = std::min(profile->m_lastSample, std::floor((center + feature.after - m_start) * profile->m_samplesPerRadian));
+            for (auto i = static_cast<size_t>(first); static_cast<float>(i) <= last; i++) {
+                table[i] += featureTorque(feature, m_start + static_cast<float>(i) / profile->m_samplesPerRadian - center);
+            }
+        }
+    }
+    if (m_periodic) {
+        // Both ends describe the same angle, make them agree exactly so wrapping is seamless
+        table.back() = table.front();
+    }
+
+    profile->m_positions = m_positions;
+    if (profile->m_positions.empty()) {
+        profile->m_positions.push_back(std::clamp(0.0f, m_start, m_end));
+    }
+    std::sort(profile->m_positions.begin(), profile->m_positions.end());
+
+    const auto& positions = profile->m_positions;
+    for (size_t i = 0; i + 1 < positions.size(); i++) {
+        profile->m_boundaries.push_back((positions[i] + positions[i + 1]) / 2.0f);
+    }
+    for (const auto& [after, offset]: m_boundaryOverrides) {
+        if (after < profile->m_boundaries.size()) {
+            profile->m_boundaries[after] = std::clamp(offset, positions[after], positions[after + 1]);
+        }
+    }
+
+    profile->m_startPosition = m_firstPosition;
+    return profile;
+}
+
+std::unique_ptr<HapticProfile> HapticProfile::fromDetentConfig(const espp::detail::DetentConfig& config) {
+    const float width    = config.position_width;
+    const float strength = config.detent_strength;
+
+    // Narrow detents need relatively more damping than wide ones, interpolate between the two factors
+    const float lower = strength * kdFactorMax;
+    const float upper = strength * kdFactorMin;
+    const float raw   = lower + (upper - lower) / (derivativeWidthUpper - derivativeWidthLower) * (width - derivativeWidthLower);
+    // Magnetic detents (explicit detent positions) feel better without damping
+    const float damping = config.detent_positions.empty() ? std::clamp(raw, std::min(lower, upper), std::max(lower, upper)) : 0.0f;
+
+    const auto hasDetentAt = [&config](const int position) {
+        const auto& positions = config.detent_positions;
+        return positions.empty() || std::find(positions.begin(), positions.end(), position) != positions.end();
+    };
+
+    if (config.max_position < config.min_position) {
+        Builder builder{-width / 2.0f, width / 2.0f};
+        builder.periodic().damping(damping);
+        if (strength > 0.0f && hasDetentAt(0)) {
+            builder.detent(0.0f, width, strength);
+        } else {
+            builder.position(0.0f);
+        }
+        return builder.build();
+    }
+
+    // Boundary between position p and p + 1, as a fraction of a detent past the center of p. The bias
+    // moves boundaries away from position 0, so positions near 0 hold on a little longer.
+    const float snap          = std::min(config.snap_point, 0.5f);
+    const auto  boundaryAfter = [&](const int position) {
+        float fraction = snap;
+        if (position >= 0) {
+            fraction += config.snap_point_bias;
+        } else if (position + 1 <= 0) {
+            fraction -= config.snap_point_bias;
+        }
+        return std::clamp(fraction, 1.0f - maxBoundaryFraction, maxBoundaryFraction) * width;
+    };
+
+    Builder builder{(static_cast<float>(config.min_position) - 0.5f) * width, (static_cast<float>(config.max_position) + 0.5f) * width};
+    builder.firstPosition(config.min_position).endStops(config.end_strength).damping(damping);
+    for (int position = config.min_position; position <= config.max_position; position++) {
+        const float center = static_cast<float>(position) * width;
+        const float before = position == config.min_position ? width / 2.0f : width - boundaryAfter(position - 1);
+        const float after  = position == config.max_position ? width / 2.0f : boundaryAfter(position);
+
+        if (strength > 0.0f && hasDetentAt(position)) {
+            builder.detent(center, before, after, strength);
+        } else {
+            builder.position(center);
+        }
+        if (position != config.max_position) {
+            builder.boundary(static_cast<size_t>(position - config.min_position), center + after);
+        }
+    }
+    return builder.build();
+}
+
+std::expected<std::unique_ptr<HapticProfile>, std::error_code> HapticProfile::fromJson(const nlohmann::json& json) {
+    const auto number = [](const nlohmann::json& object, const char* key, const float fallback) -> std::expected<float, std::error_code> {
+        if (!object.contains(key)) {
+            return fallback;
+        }
+        if (!object[key].is_number()) {
+            return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+        }
+        return object[key].get<float>();
+    };
+
+    if (!json.is_object() || !json.contains("features") || !json["features"].is_array()) {
+        return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+    }
+
+    const auto start         = number(json, "start", 0.0f);
+    const auto end           = number(json, "end", 360.0f);
+    const auto endStrength   = number(json, "endStrength", 0.0f);
+    const auto damping       = number(json, "damping", 0.0f);
+    const auto firstPosition = number(json, "firstPosition", 0.0f);
+    for (const auto* value: {&start, &end, &endStrength, &damping, &firstPosition}) {
+        if (!value->has_value()) {
+            return std::unexpected(value->error());
+        }
+    }
+    if (end.value() <= start.value()) {
+        return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+    }
+
+    Builder builder{start.value() * fastMath::degreesToRadians, end.value() * fastMath::degreesToRadians};
+    builder.endStops(endStrength.value()).damping(damping.value()).firstPosition(static_cast<int>(firstPosition.value()));
+    if (json.contains("periodic") && json["periodic"].is_boolean() && json["periodic"].get<bool>()) {
+        builder.periodic();
+    }
+
+    for (const auto& feature: json["features"]) {
+        if (!feature.is_object() || !feature.contains("type") || !feature["type"].is_string()) {
+            return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+        }
+
+        const auto center   = number(feature, "center", 0.0f);
+        const auto width    = number(feature, "width", 0.0f);
+        const auto strength = number(feature, "strength", 1.0f);
+        if (!center || !width || !strength) {
+            return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+        }
+
+        const auto  type          = feature["type"].get<std::string>();
+        const float centerRadians = center.value() * fastMath::degreesToRadians;
+        const float widthRadians  = width.value() * fastMath::degreesToRadians;
+        if (type == "position") {
+            builder.position(centerRadians);
+        } else if (widthRadians <= 0.0f) {
+            return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+        } else if (type == "detent") {
+            builder.detent(centerRadians, widthRadians, strength.value());
+        } else if (type == "notch") {
+            builder.notch(centerRadians, widthRadians, strength.value());
+        } else if (type == "snap") {
+            builder.snap(centerRadians, widthRadians, strength.value());
+        } else {
+            return std::unexpected(std::make_error_code(ESP_ERR_NOT_SUPPORTED));
+        }
+    }
+
+    return builder.build();
+}
+
+std::expected<std::unique_ptr<HapticProfile>, std::error_code> HapticProfile::fromFile(const std::string_view path) {
+    std::ifstream file{std::string{path}};
+    if (!file) {
+        return std::unexpected(std::error_code(errno, std::generic_category()));
+    }
+
+    const auto json = nlohmann::json::parse(file, nullptr, false);
+    if (json.is_discarded()) {
+        return std::unexpected(std::make_error_code(ESP_ERR_INVALID_ARG));
+    }
+    return fromJson(json);
+}
+
+int HapticProfile::positionAt(const float offset) const {
+    const auto count = static_cast<int>(m_positions.size());
+    if (!m_periodic) {
+        const auto index = std::upper_bound(m_boundaries.begin(), m_boundaries.end(), offset) - m_boundaries.begin();
+        return m_firstPosition + static_cast<int>(index);
+    }
+
+    // Fold the offset into one period that starts at the boundary between the last and first position
+    const float base  = (m_positions.back() + m_positions.front() + m_period) / 2.0f - m_period;
+    const float wraps = fastMath::floor((offset - base) / m_period);
+    const float local = offset - wraps * m_period;
+    const auto  index = std::upper_bound(m_boundaries.begin(), m_boundaries.end(), local) - m_boundaries.begin();
+    return m_firstPosition + static_cast<int>(wraps) * count + static_cast<int>(index);
+}
+
+float HapticProfile::offsetOf(const int position) const {
+    const auto count = static_cast<int>(m_positions.size());
+    const int  index = position - m_firstPosition;
+    if (!m_periodic) {
+        return m_positions[std::clamp(index, 0, count - 1)];
+    }
+
+    const int wraps = index >= 0 ? index / count : -((-index + count - 1) / count);
+    return m_positions[index - wraps * count] + static_cast<float>(wraps) * m_period;
+}
+
+void HapticProfile::setStartPosition(const int position) {
+    m_startPosition = m_periodic ? position : std::clamp(position, minPosition(), maxPosition());
+}
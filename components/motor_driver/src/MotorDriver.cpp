@@ -1,5 +1,13 @@
 #include "MotorDriver.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <optional>
+
+#include "esp_system_error.hpp"
+#include "esp_timer.h"
+
 using Status = sdk::Component::Status;
 using res = sdk::Component::res;
 
@@ -8,84 +16,942 @@ Status MotorDriver::initialize() {
         return m_status;
     }
 
+    // The FOC loop samples the encoder on every tick
+    if (m_magneticEncoder == nullptr) {
+        ESP_LOGE(TAG, "No sensor set, call setSensor() before starting the motor driver");
+        m_err = ESP_ERR_INVALID_STATE;
+        return m_status = Status::ERROR;
+    }
+
     m_status = Status::INITIALIZING;
 
+    // Start the FOC task first, it is the only encoder sampler from here on, also during motor alignment
+    m_run = true;
+    m_focTaskError.store(ESP_OK, std::memory_order_relaxed);
+    if (xTaskCreatePinnedToCore(startFocTask, "FOC", 4096, this, configMAX_PRIORITIES - 1, nullptr, CONFIG_MOTOR_DRIVER_FOC_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create FOC task");
+        m_run = false;
+        m_err = ESP_ERR_NO_MEM;
+        return m_status = Status::ERROR;
+    }
+    while (!m_focLoopRunning && m_focTaskError.load(std::memory_order_acquire) == ESP_OK) {
+        vTaskDelay(1);
+    }
+    if (const esp_err_t err = m_focTaskError.load(std::memory_order_acquire)) {
+        m_run = false;
+        m_err = err;
+        return m_status = Status::ERROR;
+    }
+
+    // Known offset and direction make BldcMotor skip its own alignment sweep
+    setupElectricalCalibration();
+    applyTunedGains();
+    if (!m_coggingConfig.isDefault()) {
+        m_cogging.load(m_coggingConfig.table.value());
+    }
+    m_motor = std::make_shared<bldcMotor>(m_motorConfig);
+    // Haptics, autotune and the cogging sweep command a torque (voltage), homing switches to the angle
+    // loop while it runs. BldcMotor starts out in open loop velocity mode.
+    m_motor->set_motion_control_type(espp::detail::MotionControlType::TORQUE);
     m_motor->initialize();
     m_motor->enable();
 
-    m_haptics->update_detent_config(espp::detail::COARSE_VALUES_STRONG_DETENTS);
-    m_haptics->start();
+    setDetentConfig(espp::detail::COARSE_VALUES_STRONG_DETENTS, 0);
+    m_motorReady     = true;
+    m_hapticsEnabled = true;
 
     return m_status = Status::RUNNING;
 }
 
+MotorDriver::~MotorDriver() {
+    delete m_pendingProfile.exchange(nullptr);
+    delete m_retiredProfile.exchange(nullptr);
+}
+
 Status MotorDriver::run() {
-    if (m_status == Status::RUNNING) {
-        m_motor->loop_foc();
+    // A profile the FOC task is done with, it never frees memory itself
+    delete m_retiredProfile.exchange(nullptr, std::memory_order_acquire);
+
+    if (m_magneticEncoder == nullptr) {
+        m_err = ESP_ERR_INVALID_STATE;
+        return m_status = Status::ERROR;
     }
+    reportHoming();
     return m_status;
 }
 
 Status MotorDriver::stop() {
-    m_haptics->stop();
-    m_motor->disable();
+    m_run = false;
+    // The FOC task clears its handle right before deleting itself
+    while (m_focTaskHandle.load() != nullptr) {
+        vTaskDelay(1);
+    }
+
+    m_motorReady     = false;
+    m_hapticsEnabled = false;
+    // Not created when initialize() failed early
+    if (m_motor) {
+        m_motor->disable();
+    }
 
 	return m_status = Status::STOPPED;
 }
 
-void MotorDriver::setDetentConfig(const espp::detail::DetentConfig& config, const int position) const {
-    m_haptics->update_detent_config(config);
-    m_haptics->set_position(position);
+void MotorDriver::setDetentConfig(const espp::detail::DetentConfig& config, const int position, const uint32_t fadeTicks) {
+    setHapticProfile(HapticProfile::fromDetentConfig(config), position, fadeTicks);
+}
+
+void MotorDriver::setHapticProfile(std::unique_ptr<HapticProfile> profile, const int position, const uint32_t fadeTicks) {
+    if (!profile) {
+        return;
+    }
+    profile->setStartPosition(position);
+
+    // A profile still pending was never seen by the FOC task, it is simply replaced
+    auto* queued = new QueuedProfile{std::move(profile), fadeTicks};
+    delete m_pendingProfile.exchange(queued, std::memory_order_acq_rel);
+}
+
+std::error_code MotorDriver::calibrateEncoderLinearity() {
+    if (m_status != Status::RUNNING) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+    // The sweep is compared against the commanded angle, which means nothing without a known direction
+    if (m_motorConfig.sensor_direction == espp::detail::SensorDirection::UNKNOWN) {
+        ESP_LOGE(TAG, "Encoder linearity needs a sensor direction, the electrical calibration failed");
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+
+    ESP_LOGI(TAG, "Calibrating encoder linearity, don't touch the knob");
+    const int64_t start = esp_timer_get_time();
+
+    // The FOC task keeps sampling the encoder but stops driving the motor
+    m_motorReady = false;
+    vTaskDelay(1);
+    m_magneticEncoder->setLinearityCorrection(false);
+
+    const auto  polePairs = static_cast<float>(m_motorConfig.num_pole_pairs);
+    const auto  direction = static_cast<float>(m_motorConfig.sensor_direction);
+    const float origin    = holdOpenLoop(0.0f, pdMS_TO_TICKS(500));
+
+    // Sweep one revolution forward and back, so the lag from friction averages out
+    constexpr float       countsPerRadian = mt6701Frame::countsPerRevolution / (2.0f * static_cast<float>(M_PI));
+    EncoderLinearity::Fit fit;
+    for (int i = 0; i <= 2 * m_linearityCalibrationSteps; i++) {
+        const int   step      = i <= m_linearityCalibrationSteps ? i : 2 * m_linearityCalibrationSteps - i;
+        const float commanded = 2.0f * static_cast<float>(M_PI) * static_cast<float>(step) / m_linearityCalibrationSteps;
+        setOpenLoopVector(m_alignVoltage, commanded * polePairs);
+        vTaskDelay(pdMS_TO_TICKS(2));
+
+        const float measured = m_magneticEncoder->snapshot().radians - origin;
+        fit.addSample(m_magneticEncoder->getRawCount(), (measured - direction * commanded) * countsPerRadian);
+    }
+    m_driver->set_voltage(0, 0, 0);
+
+    const auto err = m_magneticEncoder->saveLinearityTable(fit.table());
+    m_motorReady   = true;
+
+    if (err) {
+        ESP_LOGE(TAG, "Failed to save encoder linearity table: %s", err.message().c_str());
+        return err;
+    }
+    ESP_LOGI(TAG, "Encoder linearity calibrated from %lu samples in %lld ms", fit.samples(), (esp_timer_get_time() - start) / 1000);
+    return {};
+}
+
+std::error_code MotorDriver::calibrateCogging() {
+    if (m_status != Status::RUNNING || m_autotuneRunning.load(std::memory_order_relaxed)) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+    const auto homing = m_homingState.load(std::memory_order_acquire);
+    if (homing == HomingState::PENDING || homing == HomingState::MOVING || homing == HomingState::SETTLING) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+
+    ESP_LOGI(TAG, "Calibrating cogging, don't touch the knob");
+    const int64_t start = esp_timer_get_time();
+
+    // The sweep measures the bare motor, not the motor with the previous compensation. Every failure
+    // puts the previous map back, a failed calibration must not leave the knob uncompensated.
+    std::optional<CoggingMap::Table> previous;
+    if (!m_coggingConfig.isDefault()) {
+        previous = m_coggingConfig.table.value();
+    }
+    const auto restorePrevious = [this, &previous] {
+        if (previous) {
+            m_cogging.load(*previous);
+        }
+    };
+    m_cogging.clear();
+    m_coggingRecorder = std::make_unique<CoggingMap::Recorder>();
+    m_coggingTicks    = 0;
+    m_coggingRunning.store(true, std::memory_order_release);
+    while (m_coggingRunning.load(std::memory_order_acquire) && m_focLoopRunning.load(std::memory_order_relaxed)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (m_coggingRunning.exchange(false)) {
+        ESP_LOGE(TAG, "Cogging calibration aborted, the FOC loop stopped");
+        restorePrevious();
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+
+    const uint32_t samples = m_coggingRecorder->samples();
+    const auto     table   = m_coggingRecorder->table();
+    m_coggingRecorder.reset();
+    if (!table) {
+        ESP_LOGE(TAG, "Cogging calibration failed, the sweep missed part of the revolution: %s", table.error().message().c_str());
+        restorePrevious();
+        return table.error();
+    }
+
+    const auto [min, max] = std::minmax_element(table->begin(), table->end());
+    ESP_LOGI(TAG, "Cogging calibrated from %lu samples in %lld ms, %d mV peak to peak", samples,
+             (esp_timer_get_time() - start) / 1000, *max - *min);
+
+    m_coggingConfig.updateField(m_coggingConfig.table, table.value());
+    if (const auto err = m_coggingConfig.save()) {
+        ESP_LOGE(TAG, "Unable to save cogging map: %s", err.message().c_str());
+        m_coggingConfig.updateField(m_coggingConfig.table, previous.value_or(CoggingMap::Table{}));
+        restorePrevious();
+        return err;
+    }
+    m_cogging.load(table.value());
+    return {};
+}
+
+std::error_code MotorDriver::autotune(const uint32_t targetSettlingMs) {
+    if (m_status != Status::RUNNING || m_coggingRunning.load(std::memory_order_relaxed)) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+    const auto homing = m_homingState.load(std::memory_order_acquire);
+    if (homing == HomingState::PENDING || homing == HomingState::MOVING || homing == HomingState::SETTLING) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+
+    ESP_LOGI(TAG, "Autotuning for a %lu ms settling time, don't touch the knob", targetSettlingMs);
+    m_autotune.start();
+    m_autotuneRunning.store(true, std::memory_order_release);
+    while (m_autotuneRunning.load(std::memory_order_acquire) && m_focLoopRunning.load(std::memory_order_relaxed)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (m_autotuneRunning.exchange(false)) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+
+    const auto result = m_autotune.result(static_cast<float>(targetSettlingMs) / 1000.0f);
+    if (!result) {
+        ESP_LOGE(TAG, "Autotune failed, the knob did not oscillate as expected: %s", result.error().message().c_str());
+        return result.error();
+    }
+
+    const auto& [velocity, angle, gain, pole, period, ultimateGain] = result.value();
+    ESP_LOGI(TAG, "Identified plant gain %.1f, pole %.2f 1/s, relay period %.1f ms, ultimate gain %.3f",
+             gain, pole, period * 1000.0f, ultimateGain);
+    ESP_LOGI(TAG, "Velocity PID %.4f/%.4f/%.4f (was %.4f/%.4f/%.4f), angle PID %.4f/%.4f/%.4f (was %.4f/%.4f/%.4f)",
+             velocity.kp, velocity.ki, velocity.kd, m_motorConfig.velocity_pid_config.kp, m_motorConfig.velocity_pid_config.ki,
+             m_motorConfig.velocity_pid_config.kd, angle.kp, angle.ki, angle.kd, m_motorConfig.angle_pid_config.kp,
+             m_motorConfig.angle_pid_config.ki, m_motorConfig.angle_pid_config.kd);
+
+    // A 0 gain would be saved but read back as "not tuned", the plant's own damping already exceeds the target
+    if (velocity.kp <= 0.0f || angle.kp <= 0.0f) {
+        ESP_LOGE(TAG, "Autotune found no proportional gain, ask for a settling time shorter than %lu ms", targetSettlingMs);
+        return std::make_error_code(ESP_ERR_INVALID_ARG);
+    }
+
+    m_config.updateField(m_config.velocityKp, velocity.kp);
+    m_config.updateField(m_config.velocityKi, velocity.ki);
+    m_config.updateField(m_config.velocityKd, velocity.kd);
+    m_config.updateField(m_config.angleKp, angle.kp);
+    m_config.updateField(m_config.angleKi, angle.ki);
+    m_config.updateField(m_config.angleKd, angle.kd);
+    if (const auto err = m_config.save()) {
+        ESP_LOGE(TAG, "Unable to save autotuned gains: %s", err.message().c_str());
+        return err;
+    }
+    return {};
+}
+
+void MotorDriver::applyTunedGains() {
+    if (m_config.velocityKp.value() <= 0.0f || m_config.angleKp.value() <= 0.0f) {
+        return;
+    }
+
+    m_motorConfig.velocity_pid_config.kp = m_config.velocityKp.value();
+    m_motorConfig.velocity_pid_config.ki = m_config.velocityKi.value();
+    m_motorConfig.velocity_pid_config.kd = m_config.velocityKd.value();
+    m_motorConfig.angle_pid_config.kp    = m_config.angleKp.value();
+    m_motorConfig.angle_pid_config.ki    = m_config.angleKi.value();
+    m_motorConfig.angle_pid_config.kd    = m_config.angleKd.value();
+    ESP_LOGI(TAG, "Using autotuned PID gains");
+}
+
+MotorDriver::IdleStats MotorDriver::getIdleStats() const {
+    return {
+            .idle              = m_idle.load(std::memory_order_relaxed),
+            .entries           = m_idleEntries.load(std::memory_order_relaxed),
+            .lastWakeLatencyUs = m_lastWakeLatencyUs.load(std::memory_order_relaxed),
+            .maxWakeLatencyUs  = m_maxWakeLatencyUs.load(std::memory_order_relaxed),
+            .idleTimeMs        = m_idleTimeMs.load(std::memory_order_relaxed)};
 }
 
-void MotorDriver::setSensor(const std::shared_ptr<encoder>& magnetic_encoder) {
-    m_encoder = magnetic_encoder;
-    m_driver  = std::make_shared<espp::BldcDriver>(m_driverConfig);
+MotorDriver::LoopStats MotorDriver::getLoopStats() const {
+    return {
+            .iterations   = m_loopIterations.load(std::memory_order_relaxed),
+            .minPeriodUs  = m_minPeriodUs.load(std::memory_order_relaxed),
+            .maxPeriodUs  = m_maxPeriodUs.load(std::memory_order_relaxed),
+            .meanPeriodUs = m_meanPeriodUs.load(std::memory_order_relaxed)};
+}
+
+std::error_code MotorDriver::setSensor(MagneticEncoder& magneticEncoder) {
+    auto device = magneticEncoder.getDevice();
+    if (!device.has_value()) {
+        return device.error();
+    }
+
+    m_magneticEncoder = &magneticEncoder;
+    m_encoder         = device.value();
+#if defined(CONFIG_MOTOR_DRIVER_LOOP_PROFILER) || defined(CONFIG_MOTOR_DRIVER_PWM_SYNC)
+    m_driver          = std::make_shared<bldcDriver>(m_driverConfig, m_profiler, m_focTaskHandle);
+#else
+    m_driver          = std::make_shared<bldcDriver>(m_driverConfig);
+#endif
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    m_driver->setPwmSync(&m_pwmSync);
+#endif
 
-    m_motorConfig.sensor = magnetic_encoder;
+    // The motor itself is created in initialize(), once the electrical calibration is known
+    m_motorConfig.sensor = m_encoder;
     m_motorConfig.driver = m_driver;
-    m_motor              = std::make_shared<bldcMotor>(m_motorConfig);
+    return {};
+}
+
+std::error_code MotorDriver::startHoming(const uint32_t timeoutMs, HomingCallback onFinished) {
+    if (m_status != Status::RUNNING) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
 
-    m_hapticsConfig.motor = *m_motor.get();
-    m_haptics = std::make_unique<BldcHaptics>(m_hapticsConfig);
+    const auto state = m_homingState.load(std::memory_order_acquire);
+    if (state == HomingState::PENDING || state == HomingState::MOVING || state == HomingState::SETTLING) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+    // run() may still be about to call the previous callback
+    if (m_homingResultPending.load(std::memory_order_acquire)) {
+        return std::make_error_code(ESP_ERR_INVALID_STATE);
+    }
+
+    m_homingCallback  = std::move(onFinished);
+    m_homingTimeoutMs = timeoutMs;
+    m_homingAbort.store(false, std::memory_order_relaxed);
+    m_homingProgress.store(0.0f, std::memory_order_relaxed);
+    m_homingState.store(HomingState::PENDING, std::memory_order_release);
+    return {};
 }
 
-void MotorDriver::setZero() const {
-    m_haptics->stop();
+void MotorDriver::setupElectricalCalibration() {
+    const int64_t start = esp_timer_get_time();
+    m_driver->enable();
+
+    if (!m_config.isDefault()) {
+        const float offset    = m_config.zeroElectricOffset.value();
+        const auto  direction = static_cast<espp::detail::SensorDirection>(m_config.sensorDirection.value());
+        if (verifyElectricalCalibration(offset, direction)) {
+            m_motorConfig.zero_electric_offset = offset;
+            m_motorConfig.sensor_direction     = direction;
 
-    updateMotionControlType(espp::detail::MotionControlType::ANGLE);
+            const auto tookMs = static_cast<int32_t>((esp_timer_get_time() - start) / 1000);
+            ESP_LOGI(TAG, "Reused saved electrical calibration, took %ld ms instead of %ld ms (saved %ld ms)",
+                     tookMs, m_config.alignmentDurationMs.value(), m_config.alignmentDurationMs.value() - tookMs);
+            return;
+        }
+        ESP_LOGW(TAG, "Saved electrical calibration failed sanity check, recalibrating");
+    }
 
-    constexpr float dampener = M_PI / 72;
+    const auto direction = measureSensorDirection();
+    if (direction == espp::detail::SensorDirection::UNKNOWN) {
+        // Nothing is saved, BldcMotor runs its own alignment and the next boot measures again
+        ESP_LOGE(TAG, "Electrical calibration failed, not saving it");
+        m_driver->set_voltage(0, 0, 0);
+        return;
+    }
+    // BldcMotor treats an offset of exactly 0 as "not calibrated"
+    const float offset = std::max(measureZeroElectricOffset(direction), std::numeric_limits<float>::min());
+    const auto  tookMs = static_cast<int32_t>((esp_timer_get_time() - start) / 1000);
 
-    auto angle = m_motor->get_shaft_angle();
+    m_motorConfig.zero_electric_offset = offset;
+    m_motorConfig.sensor_direction     = direction;
 
-    ESP_LOGI(TAG, "shaft angle: %f", angle);
+    m_config.updateField(m_config.zeroElectricOffset, offset);
+    m_config.updateField(m_config.sensorDirection, static_cast<int32_t>(direction));
+    m_config.updateField(m_config.alignmentDurationMs, tookMs);
+    if (const auto err = m_config.save()) {
+        ESP_LOGW(TAG, "Unable to save config: %s - %s", esp_err_to_name(err.value()), err.message().c_str());
+    }
 
-    while (angle < 0.0) {
-        TickType_t start = xTaskGetTickCount();
-        m_motor->move(angle + dampener);
-        m_motor->loop_foc();
-        xTaskDelayUntil(&start, portTICK_PERIOD_MS);
-        angle = m_motor->get_shaft_angle();
+    ESP_LOGI(TAG, "Full electrical calibration took %ld ms (offset %.3f rad, direction %d)",
+             tookMs, offset, static_cast<int>(direction));
+}
+
+bool MotorDriver::verifyElectricalCalibration(const float offset, const espp::detail::SensorDirection direction) const {
+    if (direction == espp::detail::SensorDirection::UNKNOWN) {
+        return false;
+    }
+
+    // Pulled to electrical zero, the saved offset should predict where the shaft ends up
+    const float aligned  = holdOpenLoop(0.0f, pdMS_TO_TICKS(150));
+    const float measured = electricalAngle(aligned, direction);
+    const float error    = std::remainder(measured - offset, 2.0f * static_cast<float>(M_PI));
+    if (std::fabs(error) > m_electricalCalibrationTolerance) {
+        ESP_LOGD(TAG, "Electrical offset off by %.3f rad", error);
+        return false;
+    }
+
+    // A quarter electrical turn forward must move the shaft in the saved direction
+    const float moved = holdOpenLoop(M_PI_2, pdMS_TO_TICKS(100)) - aligned;
+    return static_cast<float>(direction) * moved > 0.0f;
+}
+
+espp::detail::SensorDirection MotorDriver::measureSensorDirection() const {
+    // Sweep one electrical revolution forward and back, like BldcMotor's own alignment
+    constexpr int steps = 100;
+    holdOpenLoop(0.0f, pdMS_TO_TICKS(300));
+    for (int i = 0; i <= steps; i++) {
+        setOpenLoopVector(m_alignVoltage, 2.0f * static_cast<float>(M_PI) * i / steps);
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    const float forward = holdOpenLoop(2.0f * static_cast<float>(M_PI), pdMS_TO_TICKS(20));
+    for (int i = steps; i >= 0; i--) {
+        setOpenLoopVector(m_alignVoltage, 2.0f * static_cast<float>(M_PI) * i / steps);
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+    const float backward = holdOpenLoop(0.0f, pdMS_TO_TICKS(20));
+
+    // One electrical revolution turns the shaft by a pole pitch
+    const float pitch = 2.0f * static_cast<float>(M_PI) / static_cast<float>(m_motorConfig.num_pole_pairs);
+    if (std::fabs(forward - backward) < m_minAlignmentMovement * pitch) {
+        ESP_LOGE(TAG, "Shaft moved %.3f rad of the %.3f rad commanded while measuring the sensor direction",
+                 std::fabs(forward - backward), pitch);
+        return espp::detail::SensorDirection::UNKNOWN;
+    }
+    return forward > backward ? espp::detail::SensorDirection::CLOCKWISE : espp::detail::SensorDirection::COUNTER_CLOCKWISE;
+}
+
+float MotorDriver::measureZeroElectricOffset(const espp::detail::SensorDirection direction) const {
+    return electricalAngle(holdOpenLoop(0.0f, pdMS_TO_TICKS(500)), direction);
+}
+
+float MotorDriver::electricalAngle(const float shaftAngle, const espp::detail::SensorDirection direction) const {
+    const float angle = std::fmod(static_cast<float>(direction) * static_cast<float>(m_motorConfig.num_pole_pairs) * shaftAngle,
+                                  2.0f * static_cast<float>(M_PI));
+    return angle < 0.0f ? angle + 2.0f * static_cast<float>(M_PI) : angle;
+}
+
+float MotorDriver::holdOpenLoop(const float electricalAngle, const TickType_t settleTicks) const {
+    setOpenLoopVector(m_alignVoltage, electricalAngle);
+    vTaskDelay(settleTicks);
+    return m_magneticEncoder->snapshot().radians;
+}
+
+void MotorDriver::setOpenLoopVector(const float voltage, const float electricalAngle) const {
+    // Inverse Clarke transform of a vector at electricalAngle, centered on half the supply voltage
+    constexpr float sqrt3_2 = 0.86602540378f;
+    const float     alpha   = voltage * std::cos(electricalAngle);
+    const float     beta    = voltage * std::sin(electricalAngle);
+    const float     center  = m_driverConfig.power_supply_voltage / 2.0f;
+    m_driver->set_voltage(center + alpha,
+                          center - 0.5f * alpha + sqrt3_2 * beta,
+                          center - 0.5f * alpha - sqrt3_2 * beta);
+}
+
+bool IRAM_ATTR MotorDriver::onFocTimer(gptimer_handle_t, const gptimer_alarm_event_data_t*, void* _this) {
+    auto*      m                       = static_cast<MotorDriver*>(_this);
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(m->m_focTaskHandle.load(std::memory_order_relaxed), &higherPriorityTaskWoken);
+    return higherPriorityTaskWoken == pdTRUE;
+}
+
+void MotorDriver::startFocTask(void* _this) {
+    auto* m = static_cast<MotorDriver*>(_this);
+    m->m_focTaskHandle = xTaskGetCurrentTaskHandle();
+    m->focTask();
+    // When the focTask function returns, the task is finished and should be deleted
+    m->m_focTaskHandle = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void MotorDriver::focTask() {
+    // The timer is created from this task so its interrupt is allocated on the same core
+    if (const auto err = startFocTimer()) {
+        ESP_LOGE(TAG, "Failed to start FOC timer: %s", err.message().c_str());
+        // Frees a timer created before the step that failed
+        stopFocTimer();
+        m_focTaskError.store(static_cast<esp_err_t>(err.value()), std::memory_order_release);
+        return;
+    }
+
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    // Unsynced ticks still run when this fails, only later
+    if (const auto err = m_pwmSync.start(m_driverConfig.gpio_a_h, m_focTimer, m_focLoopPeriodTicks)) {
+        ESP_LOGE(TAG, "Failed to sync FOC loop to PWM: %s", err.message().c_str());
+    }
+#endif
+
+    ESP_LOGI(TAG, "FOC loop running at %d Hz on core %d", CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY, xPortGetCoreID());
+    m_magneticEncoder->setExternalSampler(true);
+    m_focLoopRunning = true;
+
+    while (m_run) {
+        // The timeout only exists so a paused timer doesn't keep the task from seeing m_run
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) == 0) {
+            continue;
+        }
+        focStep();
     }
 
-    while (angle > 0.0) {
-        TickType_t start = xTaskGetTickCount();
-        m_motor->move(angle - dampener);
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    m_pwmSync.stop();
+#endif
+    stopFocTimer();
+    m_focLoopRunning = false;
+    m_magneticEncoder->setExternalSampler(false);
+}
+
+void MotorDriver::focStep() {
+    updateProfile();
+    const int64_t now = esp_timer_get_time();
+    if (!m_idle.load(std::memory_order_relaxed)) {
+        updateLoopStats(now);
+    }
+#ifdef CONFIG_MOTOR_DRIVER_LOOP_PROFILER
+    m_profiler.applyReset();
+#endif
+    LoopProfiler::Scope tickProbe(m_profiler, LoopProfiler::Probe::TICK);
+
+    {
+        // A failed read keeps the previous sample, the next tick simply tries again
+        LoopProfiler::Scope probe(m_profiler, LoopProfiler::Probe::ENCODER_READ);
+        m_magneticEncoder->sample();
+    }
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    m_pwmSync.markSample();
+#endif
+    if (!m_motorReady.load(std::memory_order_relaxed)) {
+        // Calibration drives the motor from another task, it needs the driver enabled
+        if (m_idle.load(std::memory_order_relaxed)) {
+            exitIdle(now);
+        }
+        return;
+    }
+    if (!updateIdle(now)) {
+        return;
+    }
+
+    {
+        LoopProfiler::Scope probe(m_profiler, LoopProfiler::Probe::HAPTICS);
+        // Waveforms keep time while homing or autotune own the command, they are only heard over haptics
+        const float waveform = waveformCommand();
+        if (!autotuneStep() && !coggingStep() && !homingStep() && m_hapticsEnabled.load(std::memory_order_relaxed)) {
+            const float limit   = m_driverConfig.power_supply_voltage;
+            const float cogging = m_cogging.feedForward(m_magneticEncoder->getRawCount());
+            m_motor->move(std::clamp(hapticTorque() + waveform + cogging, -limit, limit));
+        }
+    }
+
+    {
+        LoopProfiler::Scope probe(m_profiler, LoopProfiler::Probe::FOC);
         m_motor->loop_foc();
-        xTaskDelayUntil(&start, portTICK_PERIOD_MS);
-        angle = m_motor->get_shaft_angle();
+    }
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    m_pwmSync.markPwmWritten();
+#endif
+}
+
+bool MotorDriver::homingStep() {
+    auto state = m_homingState.load(std::memory_order_acquire);
+    if (state != HomingState::PENDING && state != HomingState::MOVING && state != HomingState::SETTLING) {
+        return false;
+    }
+
+    const int64_t now      = esp_timer_get_time();
+    const float   angle    = m_motor->get_shaft_angle();
+    const float   velocity = m_motor->get_shaft_velocity();
+
+    if (state == HomingState::PENDING) {
+        m_homingStartAngle   = angle;
+        m_homingSetpoint     = angle;
+        m_homingDeadlineUs   = now + static_cast<int64_t>(m_homingTimeoutMs) * 1000;
+        m_homingSettledTicks = 0;
+        state                = HomingState::MOVING;
+        m_homingState.store(state, std::memory_order_relaxed);
+        // The angle and velocity loops run on the autotuned gains, finishHoming() switches back
+        m_motor->set_motion_control_type(espp::detail::MotionControlType::ANGLE);
+    }
+
+    if (m_homingAbort.exchange(false, std::memory_order_relaxed)) {
+        finishHoming(HomingState::ABORTED);
+        return false;
+    }
+    if (now > m_homingDeadlineUs) {
+        finishHoming(HomingState::TIMED_OUT);
+        return false;
+    }
+
+    constexpr float step = m_homingSpeed / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+    m_homingSetpoint -= std::clamp(m_homingSetpoint, -step, step);
+
+    m_motor->move(m_homingSetpoint);
+
+    const float distance = std::fabs(m_homingStartAngle);
+    m_homingProgress.store(distance > 0.0f ? std::clamp(1.0f - std::fabs(angle) / distance, 0.0f, 1.0f) : 1.0f,
+                           std::memory_order_relaxed);
+
+    if (m_homingSetpoint != 0.0f) {
+        return true;
+    }
+    if (state == HomingState::MOVING) {
+        m_homingState.store(HomingState::SETTLING, std::memory_order_relaxed);
+    }
+
+    const bool atRest = std::fabs(angle) < m_homingTolerance && std::fabs(velocity) < m_homingSettleSpeed;
+    m_homingSettledTicks = atRest ? m_homingSettledTicks + 1 : 0;
+    if (m_homingSettledTicks >= m_homingSettleTicks) {
+        m_homingProgress.store(1.0f, std::memory_order_relaxed);
+        finishHoming(HomingState::DONE);
+    }
+    return true;
+}
+
+bool MotorDriver::autotuneStep() {
+    if (!m_autotuneRunning.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    if (m_autotune.ticks() >= m_autotuneTicks) {
+        m_motor->move(0.0f);
+        // Recenter the haptic profile on wherever the experiment left the shaft
+        recenterProfile();
+        m_autotuneRunning.store(false, std::memory_order_release);
+        return true;
+    }
+
+    m_motor->move(m_autotune.step(m_motor->get_shaft_angle(), m_motor->get_shaft_velocity()));
+    return true;
+}
+
+bool MotorDriver::coggingStep() {
+    if (!m_coggingRunning.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    const float angle    = m_motor->get_shaft_angle();
+    const float velocity = m_motor->get_shaft_velocity();
+    if (m_coggingTicks == 0) {
+        m_coggingStart    = angle;
+        m_coggingIntegral = 0.0f;
+    }
+
+    // Hold, sweep out, hold, sweep back. Only the sweeps are recorded, at constant speed.
+    constexpr float    step      = m_coggingSweepSpeed / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+    constexpr uint32_t outStart  = m_coggingSettleTicks;
+    constexpr uint32_t outEnd    = outStart + m_coggingSweepTicks;
+    constexpr uint32_t backStart = outEnd + m_coggingSettleTicks;
+    constexpr uint32_t backEnd   = backStart + m_coggingSweepTicks;
+
+    const uint32_t tick = m_coggingTicks++;
+    if (tick >= backEnd) {
+        m_motor->move(0.0f);
+        // Recenter the haptic profile on wherever the sweep left the shaft
+        recenterProfile();
+        m_coggingRunning.store(false, std::memory_order_release);
+        return true;
+    }
+
+    float setpoint = m_coggingStart;
+    if (tick >= backStart) {
+        setpoint += static_cast<float>(backEnd - tick) * step;
+    } else if (tick >= outStart) {
+        setpoint += static_cast<float>(std::min(tick, outEnd) - outStart) * step;
+    }
+
+    // The integral takes up the cogging, so the command converges on the holding effort
+    const float error = setpoint - angle;
+    m_coggingIntegral = std::clamp(m_coggingIntegral + m_coggingKi * error / CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY,
+                                   -m_coggingVoltageLimit, m_coggingVoltageLimit);
+    const float command = std::clamp(m_coggingKp * error + m_coggingIntegral - m_coggingKd * velocity,
+                                     -m_coggingVoltageLimit, m_coggingVoltageLimit);
+    m_motor->move(command);
+
+    if (tick >= backStart || (tick >= outStart && tick < outEnd)) {
+        m_coggingRecorder->addSample(m_magneticEncoder->getRawCount(), command, tick >= backStart);
+    }
+    return true;
+}
+
+void MotorDriver::finishHoming(const HomingState state) {
+    // Haptics command a torque again, from this tick on. Recenter the haptic profile on wherever homing
+    // left the shaft.
+    m_motor->set_motion_control_type(espp::detail::MotionControlType::TORQUE);
+    recenterProfile();
+
+    // Pending before the state is published, so startHoming() can't replace the callback before run() called it
+    m_homingFinalAngle.store(m_motor->get_shaft_angle(), std::memory_order_relaxed);
+    m_homingResultPending.store(true, std::memory_order_relaxed);
+    m_homingState.store(state, std::memory_order_release);
+}
+
+void MotorDriver::reportHoming() {
+    // The final state is published last, once it is seen the pending flag and angle are too
+    const auto state = m_homingState.load(std::memory_order_acquire);
+    if (state != HomingState::DONE && state != HomingState::TIMED_OUT && state != HomingState::ABORTED) {
+        return;
+    }
+    if (!m_homingResultPending.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Homing finished in state %d at %f rad", static_cast<int>(state), m_homingFinalAngle.load(std::memory_order_relaxed));
+    if (m_homingCallback) {
+        m_homingCallback(state);
+    }
+    m_homingResultPending.store(false, std::memory_order_release);
+}
+
+void MotorDriver::updateProfile() {
+    if (m_fadeFrom) {
+        if (--m_fadeTicksLeft == 0) {
+            m_retiredProfile.store(m_fadeFrom.release(), std::memory_order_release);
+        }
+        return;
     }
 
-    ESP_LOGI(TAG, "settled angle: %f", angle);
+    // Waits for run() to free the last retired profile, adopting retires one
+    if (m_retiredProfile.load(std::memory_order_relaxed) != nullptr) {
+        return;
+    }
+    std::unique_ptr<QueuedProfile> queued(m_pendingProfile.exchange(nullptr, std::memory_order_acq_rel));
+    if (!queued) {
+        return;
+    }
 
-    updateMotionControlType(espp::detail::MotionControlType::TORQUE);
-    setDetentConfig(espp::detail::COARSE_VALUES_STRONG_DETENTS, 50);
-    m_haptics->start();
+    if (m_activeProfile && !m_recenter && queued->fadeTicks > 0) {
+        m_fadeFrom      = std::move(m_activeProfile);
+        m_fadeOrigin    = m_profileOrigin;
+        m_fadeLength    = queued->fadeTicks;
+        m_fadeTicksLeft = queued->fadeTicks;
+    } else if (m_activeProfile) {
+        m_retiredProfile.store(m_activeProfile.release(), std::memory_order_release);
+    }
+    m_activeProfile = std::move(queued);
+    m_recenter      = true;
 }
 
-void MotorDriver::updateMotionControlType(espp::detail::MotionControlType motionControlType) const {
+float MotorDriver::hapticTorque() {
+    const float angle = m_motor->get_shaft_angle();
+
+    if (!m_activeProfile) {
+        return 0.0f;
+    }
+    const HapticProfile* profile = m_activeProfile->profile.get();
+
+    // A new profile starts centered on its start position, wherever the shaft is right now
+    if (m_recenter) {
+        m_recenter      = false;
+        m_profileOrigin = angle + profile->offsetOf(profile->startPosition());
+    }
+
+    // Profile offsets are clockwise, shaft angles counter-clockwise
+    const float offset = m_profileOrigin - angle;
+    m_position.store(profile->positionAt(offset), std::memory_order_relaxed);
+
+    const float velocity = m_motor->get_shaft_velocity();
+    if (std::fabs(velocity) > m_maxHapticVelocity) {
+        return 0.0f;
+    }
+
+    const float limit   = m_driverConfig.power_supply_voltage;
+    const float command = profile->command(offset, velocity, limit);
+    if (!m_fadeFrom) {
+        return command;
+    }
+
+    // Smoothstep weight, so the rate of change of torque is continuous at both ends of the fade
+    const float progress = 1.0f - static_cast<float>(m_fadeTicksLeft) / static_cast<float>(m_fadeLength);
+    const float weight   = progress * progress * (3.0f - 2.0f * progress);
+    const float previous = m_fadeFrom->profile->command(m_fadeOrigin - angle, velocity, limit);
+    return previous + weight * (command - previous);
+}
+
+float MotorDriver::waveformCommand() {
+    WaveformPlayer::Trigger trigger;
+    while (xQueueReceive(m_waveformQueue, &trigger, 0) == pdTRUE) {
+        m_waveformPlayer.trigger(trigger);
+    }
+    return m_waveformPlayer.step();
+}
+
+void MotorDriver::recenterProfile() {
+    m_recenter = true;
+    // The retired slot is empty while a fade is in progress, see m_retiredProfile
+    if (m_fadeFrom) {
+        m_retiredProfile.store(m_fadeFrom.release(), std::memory_order_release);
+    }
+    m_fadeTicksLeft = 0;
+}
+
+bool MotorDriver::updateIdle(const int64_t now) {
+    if constexpr (m_idleTimeoutUs == 0) {
+        return true;
+    }
+
+    const float angle  = m_magneticEncoder->snapshot().radians;
+    const bool  moved  = std::fabs(angle - m_idleReferenceAngle) > m_idleMotionThreshold;
+    const auto  homing = m_homingState.load(std::memory_order_relaxed);
+    const bool  active = moved || m_activity.exchange(false, std::memory_order_relaxed) ||
+                        uxQueueMessagesWaiting(m_waveformQueue) > 0 || m_waveformPlayer.playing() ||
+                        m_autotuneRunning.load(std::memory_order_relaxed) || m_coggingRunning.load(std::memory_order_relaxed) ||
+                        homing == HomingState::PENDING ||
+                        homing == HomingState::MOVING || homing == HomingState::SETTLING;
+    if (moved) {
+        m_idleReferenceAngle = angle;
+    }
+
+    if (m_idle.load(std::memory_order_relaxed)) {
+        if (active) {
+            exitIdle(now);
+            return true;
+        }
+        m_lastIdleSampleUs = now;
+#ifdef CONFIG_MOTOR_DRIVER_IDLE_HOLD
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // First full-rate tick after waking up
+    if (m_wakeStartUs != 0) {
+        const auto latency = static_cast<uint32_t>(now - m_wakeStartUs);
+        m_lastWakeLatencyUs.store(latency, std::memory_order_relaxed);
+        if (latency > m_maxWakeLatencyUs.load(std::memory_order_relaxed)) {
+            m_maxWakeLatencyUs.store(latency, std::memory_order_relaxed);
+        }
+        m_wakeStartUs = 0;
+    }
+
+    if (active || m_lastActivityUs == 0) {
+        m_lastActivityUs = now;
+    } else if (now - m_lastActivityUs > m_idleTimeoutUs) {
+        enterIdle(now);
+#ifndef CONFIG_MOTOR_DRIVER_IDLE_HOLD
+        return false;
+#endif
+    }
+    return true;
+}
+
+void MotorDriver::enterIdle(const int64_t now) {
+#ifndef CONFIG_MOTOR_DRIVER_IDLE_HOLD
     m_motor->disable();
-    m_motor->set_motion_control_type(motionControlType);
+#endif
+    setFocTimerPeriod(m_idleLoopPeriodTicks);
+    m_idleSinceUs      = now;
+    m_lastIdleSampleUs = now;
+    m_idleEntries.store(m_idleEntries.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_idle.store(true, std::memory_order_relaxed);
+}
+
+void MotorDriver::exitIdle(const int64_t now) {
+    // A count past the new alarm fires right away, so the next full-rate tick is not delayed
+    setFocTimerPeriod(m_focLoopPeriodTicks);
+#ifndef CONFIG_MOTOR_DRIVER_IDLE_HOLD
     m_motor->enable();
+#endif
+    m_idleTimeMs.store(m_idleTimeMs.load(std::memory_order_relaxed) + static_cast<uint32_t>((now - m_idleSinceUs) / 1000),
+                       std::memory_order_relaxed);
+    m_wakeStartUs    = m_lastIdleSampleUs;
+    m_lastActivityUs = now;
+    // Loop periods spanning the idle time would skew the stats
+    m_lastTickUs = 0;
+    m_idle.store(false, std::memory_order_relaxed);
+}
+
+void MotorDriver::setFocTimerPeriod(const uint32_t ticks) const {
+    const gptimer_alarm_config_t alarmConfig{
+            .alarm_count  = ticks,
+            .reload_count = 0,
+            .flags        = {.auto_reload_on_alarm = true},
+    };
+    if (const auto err = gptimer_set_alarm_action(m_focTimer, &alarmConfig)) {
+        ESP_LOGE(TAG, "Failed to change FOC timer period: %s", esp_err_to_name(err));
+    }
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+    m_pwmSync.setTimerPeriod(ticks);
+#endif
+}
+
+void MotorDriver::updateLoopStats(const int64_t now) {
+    if (m_resetLoopStats.exchange(false, std::memory_order_relaxed)) {
+        m_loopIterations.store(0, std::memory_order_relaxed);
+        m_minPeriodUs.store(UINT32_MAX, std::memory_order_relaxed);
+        m_maxPeriodUs.store(0, std::memory_order_relaxed);
+        m_meanPeriodUs.store(0.0f, std::memory_order_relaxed);
+        m_periodSumUs = 0;
+        m_lastTickUs  = 0;
+    }
+
+    if (m_lastTickUs != 0) {
+        const auto period     = static_cast<uint32_t>(now - m_lastTickUs);
+        const auto iterations = m_loopIterations.load(std::memory_order_relaxed) + 1;
+        m_periodSumUs += period;
+
+        if (period < m_minPeriodUs.load(std::memory_order_relaxed)) {
+            m_minPeriodUs.store(period, std::memory_order_relaxed);
+        }
+        if (period > m_maxPeriodUs.load(std::memory_order_relaxed)) {
+            m_maxPeriodUs.store(period, std::memory_order_relaxed);
+        }
+        m_meanPeriodUs.store(static_cast<float>(m_periodSumUs) / static_cast<float>(iterations), std::memory_order_relaxed);
+        m_loopIterations.store(iterations, std::memory_order_relaxed);
+    }
+    m_lastTickUs = now;
+}
+
+std::error_code MotorDriver::startFocTimer() {
+    const gptimer_config_t timerConfig{
+            .clk_src       = GPTIMER_CLK_SRC_DEFAULT,
+            .direction     = GPTIMER_COUNT_UP,
+            .resolution_hz = m_focTimerResolutionHz,
+    };
+    if (const auto err = gptimer_new_timer(&timerConfig, &m_focTimer)) {
+        return std::make_error_code(err);
+    }
+
+    constexpr gptimer_event_callbacks_t callbacks{.on_alarm = onFocTimer};
+    if (const auto err = gptimer_register_event_callbacks(m_focTimer, &callbacks, this)) {
+        return std::make_error_code(err);
+    }
+
+    constexpr gptimer_alarm_config_t alarmConfig{
+            .alarm_count  = m_focLoopPeriodTicks,
+            .reload_count = 0,
+            .flags        = {.auto_reload_on_alarm = true},
+    };
+    if (const auto err = gptimer_set_alarm_action(m_focTimer, &alarmConfig)) {
+        return std::make_error_code(err);
+    }
+
+    if (const auto err = gptimer_enable(m_focTimer)) {
+        return std::make_error_code(err);
+    }
+
+    return std::make_error_code(gptimer_start(m_focTimer));
+}
+
+void MotorDriver::stopFocTimer() {
+    if (m_focTimer == nullptr) {
+        return;
+    }
+    gptimer_stop(m_focTimer);
+    gptimer_disable(m_focTimer);
+    gptimer_del_timer(m_focTimer);
+    m_focTimer = nullptr;
 }
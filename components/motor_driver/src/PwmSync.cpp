@@ -0,0 +1,134 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+#include "PwmSync.hpp"
+
+#include "esp_system_error.hpp"
+
+std::error_code PwmSync::start(const int gpio, gptimer_handle_t focTimer, const uint32_t periodTicks) {
+    m_focTimer = focTimer;
+    m_timerPeriodTicks.store(periodTicks, std::memory_order_relaxed);
+
+    const mcpwm_capture_timer_config_t timerConfig{
+            .group_id = CONFIG_MOTOR_DRIVER_PWM_SYNC_GROUP,
+            .clk_src  = MCPWM_CAPTURE_CLK_SRC_DEFAULT,
+    };
+    if (const auto err = mcpwm_new_capture_timer(&timerConfig, &m_captureTimer)) {
+        return std::make_error_code(err);
+    }
+    uint32_t resolutionHz = 0;
+    if (const auto err = mcpwm_capture_timer_get_resolution(m_captureTimer, &resolutionHz)) {
+        return std::make_error_code(err);
+    }
+    m_captureTicksPerUs = resolutionHz / 1000000;
+
+    // The gate pin stays an MCPWM output, loop back only enables its input path so the capture sees it
+    const mcpwm_capture_channel_config_t channelConfig{
+            .gpio_num = gpio,
+            .prescale = 1,
+            .flags    = {.pos_edge = true, .neg_edge = false, .io_loop_back = true},
+    };
+    if (const auto err = mcpwm_new_capture_channel(m_captureTimer, &channelConfig, &m_captureChannel)) {
+        return std::make_error_code(err);
+    }
+
+    const mcpwm_capture_event_callbacks_t callbacks{.on_cap = onCapture};
+    if (const auto err = mcpwm_capture_channel_register_event_callbacks(m_captureChannel, &callbacks, this)) {
+        return std::make_error_code(err);
+    }
+    if (const auto err = mcpwm_capture_channel_enable(m_captureChannel)) {
+        return std::make_error_code(err);
+    }
+    if (const auto err = mcpwm_capture_timer_enable(m_captureTimer)) {
+        return std::make_error_code(err);
+    }
+    return std::make_error_code(mcpwm_capture_timer_start(m_captureTimer));
+}
+
+void PwmSync::stop() {
+    if (m_captureTimer == nullptr) {
+        return;
+    }
+    mcpwm_capture_timer_stop(m_captureTimer);
+    mcpwm_capture_timer_disable(m_captureTimer);
+    if (m_captureChannel != nullptr) {
+        mcpwm_capture_channel_disable(m_captureChannel);
+        mcpwm_del_capture_channel(m_captureChannel);
+        m_captureChannel = nullptr;
+    }
+    mcpwm_del_capture_timer(m_captureTimer);
+    m_captureTimer = nullptr;
+}
+
+PwmSync::Stats PwmSync::stats() const {
+    const uint32_t minLatency    = m_minLatencyCycles.load(std::memory_order_relaxed);
+    const uint32_t pwmPeriodNs   = m_pwmPeriodTicks.load(std::memory_order_relaxed) * 1000 / m_captureTicksPerUs;
+    const uint32_t meanInterrupt = (m_meanInterruptCycles.load(std::memory_order_relaxed) >> m_meanShift) * 1000 / m_cyclesPerUs;
+    return {
+            .syncs           = m_syncs.load(std::memory_order_relaxed),
+            .pwmPeriodNs     = pwmPeriodNs,
+            .lastLatencyNs   = m_lastLatencyCycles.load(std::memory_order_relaxed) * 1000 / m_cyclesPerUs,
+            .minLatencyNs    = minLatency == UINT32_MAX ? 0 : minLatency * 1000 / m_cyclesPerUs,
+            .maxLatencyNs    = m_maxLatencyCycles.load(std::memory_order_relaxed) * 1000 / m_cyclesPerUs,
+            .interrupts      = m_interrupts.load(std::memory_order_relaxed),
+            .meanInterruptNs = meanInterrupt,
+            .maxInterruptNs  = m_maxInterruptCycles.load(std::memory_order_relaxed) * 1000 / m_cyclesPerUs,
+            // One interrupt per PWM period
+            .loadPermille    = pwmPeriodNs == 0 ? 0 : meanInterrupt * 1000 / pwmPeriodNs,
+    };
+}
+
+bool IRAM_ATTR PwmSync::onCapture(mcpwm_cap_channel_handle_t, const mcpwm_capture_event_data_t* eventData, void* _this) {
+    auto*          sync  = static_cast<PwmSync*>(_this);
+    const uint32_t start = esp_cpu_get_cycle_count();
+    sync->onRisingEdge(eventData->cap_value, start);
+
+    const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    const uint32_t mean   = sync->m_meanInterruptCycles.load(std::memory_order_relaxed);
+    sync->m_meanInterruptCycles.store(mean + cycles - (mean >> m_meanShift), std::memory_order_relaxed);
+    if (cycles > sync->m_maxInterruptCycles.load(std::memory_order_relaxed)) {
+        sync->m_maxInterruptCycles.store(cycles, std::memory_order_relaxed);
+    }
+    sync->m_interrupts.store(sync->m_interrupts.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return false;
+}
+
+void IRAM_ATTR PwmSync::onRisingEdge(const uint32_t captured, const uint32_t now) {
+    // The first rising edge after a write is driven by the new compare values
+    const uint32_t period = captured - m_lastRise;
+    const bool     first  = m_lastRise == 0;
+    m_lastRise            = captured;
+    m_pwmPeriodTicks.store(period, std::memory_order_relaxed);
+
+    if (m_pwmWritten.exchange(false, std::memory_order_acquire)) {
+        const uint32_t latency = now - m_sampleCycles;
+        m_lastLatencyCycles.store(latency, std::memory_order_relaxed);
+        if (latency < m_minLatencyCycles.load(std::memory_order_relaxed)) {
+            m_minLatencyCycles.store(latency, std::memory_order_relaxed);
+        }
+        if (latency > m_maxLatencyCycles.load(std::memory_order_relaxed)) {
+            m_maxLatencyCycles.store(latency, std::memory_order_relaxed);
+        }
+    }
+
+    // No period measured yet, the driver was off for a while and this edge ends a long gap, or no pulse
+    const uint32_t timerPeriod = m_timerPeriodTicks.load(std::memory_order_relaxed);
+    const uint32_t periodUs    = period / m_captureTicksPerUs;
+    const uint32_t duty        = m_duty.load(std::memory_order_relaxed);
+    if (first || periodUs > timerPeriod || duty == 0) {
+        return;
+    }
+
+    // Only the PWM period in which the FOC alarm is due gets moved, the FOC timer counts microseconds
+    uint64_t count = 0;
+    gptimer_get_raw_count(m_focTimer, &count);
+    if (count >= timerPeriod || timerPeriod - count > periodUs) {
+        return;
+    }
+
+    // The pulse is centered on the period, half its width after the rising edge
+    const uint32_t midpointUs = static_cast<uint32_t>((static_cast<uint64_t>(period) * duty) >> (m_dutyShift + 1)) / m_captureTicksPerUs;
+    gptimer_set_raw_count(m_focTimer, timerPeriod > midpointUs ? timerPeriod - midpointUs : 0);
+    m_syncs.store(m_syncs.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+#endif
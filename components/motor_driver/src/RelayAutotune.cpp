@@ -0,0 +1,109 @@
+#include "RelayAutotune.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FastMath.hpp"
+#include "esp_system_error.hpp"
+
+RelayAutotune::RelayAutotune(const float relayOutput, const float hysteresis, const float dt)
+    : m_relayOutput(relayOutput), m_hysteresis(hysteresis), m_dt(dt) {}
+
+void RelayAutotune::start() {
+    *this = RelayAutotune(m_relayOutput, m_hysteresis, m_dt);
+}
+
+float RelayAutotune::step(const float angle, const float velocity) {
+    // The previous command acted over the last tick, pair it with the velocity it led to
+    if (m_ticks > 0 && m_crossings > m_warmupCrossings) {
+        const double v = m_lastVelocity;
+        const double u = m_command;
+        const double s = m_lastVelocity > 0.0f ? 1.0 : (m_lastVelocity < 0.0f ? -1.0 : 0.0);
+        m_xx[0] += v * v;
+        m_xx[1] += v * u;
+        m_xx[2] += v * s;
+        m_xx[3] += u * u;
+        m_xx[4] += u * s;
+        m_xx[5] += s * s;
+        m_xy[0] += v * velocity;
+        m_xy[1] += u * velocity;
+        m_xy[2] += s * velocity;
+        m_samples++;
+    }
+
+    if (m_ticks == 0) {
+        m_center = angle;
+    }
+    const float error   = angle - m_center;
+    float       command = m_ticks == 0 ? m_relayOutput : m_command;
+    if (error > m_hysteresis) {
+        command = -m_relayOutput;
+    } else if (error < -m_hysteresis) {
+        command = m_relayOutput;
+    }
+
+    if (m_ticks > 0 && command != m_command) {
+        m_crossings++;
+        if (m_crossings > m_warmupCrossings) {
+            // The peak of the half cycle that just ended, as seen from the center
+            if (m_crossings > m_warmupCrossings + 1) {
+                m_amplitudeSum += m_peak;
+                m_amplitudes++;
+            } else {
+                m_firstCrossingTick = m_ticks;
+            }
+            m_lastCrossingTick = m_ticks;
+        }
+        m_peak = 0.0f;
+    }
+    m_peak = std::max(m_peak, std::fabs(error));
+
+    m_lastVelocity = velocity;
+    m_command      = command;
+    m_ticks++;
+    return command;
+}
+
+std::expected<RelayAutotune::Result, std::error_code> RelayAutotune::result(const float targetSettlingS) const {
+    if (m_crossings < m_warmupCrossings + m_minCrossings || m_amplitudes == 0) {
+        return std::unexpected(std::make_error_code(ESP_ERR_INVALID_RESPONSE));
+    }
+
+    // Solve the symmetric 3x3 normal equations with Cramer's rule
+    const auto& [xvv, xvu, xvs, xuu, xus, xss] = m_xx;
+    const double det = xvv * (xuu * xss - xus * xus) - xvu * (xvu * xss - xus * xvs) + xvs * (xvu * xus - xuu * xvs);
+    if (std::fabs(det) < 1e-12) {
+        return std::unexpected(std::make_error_code(ESP_ERR_INVALID_RESPONSE));
+    }
+    const auto& [yv, yu, ys] = m_xy;
+    const double a = (yv * (xuu * xss - xus * xus) - xvu * (yu * xss - xus * ys) + xvs * (yu * xus - xuu * ys)) / det;
+    const double b = (xvv * (yu * xss - ys * xus) - yv * (xvu * xss - xus * xvs) + xvs * (xvu * ys - yu * xvs)) / det;
+
+    // Per tick coefficients to a continuous model: dv/dt = -pole v + gain u
+    const float gain = static_cast<float>(b) / m_dt;
+    const float pole = std::max(0.0f, static_cast<float>(1.0 - a) / m_dt);
+    if (!std::isfinite(gain) || gain <= 0.0f || a <= 0.0 || a > 1.05) {
+        return std::unexpected(std::make_error_code(ESP_ERR_INVALID_RESPONSE));
+    }
+
+    // A first order angle loop settles to 2% in about four time constants
+    const float maxVelocityBandwidth = m_maxBandwidthFraction * fastMath::tau / m_dt;
+    const float velocityBandwidth    = std::min(m_cascadeSeparation * 4.0f / targetSettlingS, maxVelocityBandwidth);
+    const float angleBandwidth       = velocityBandwidth / m_cascadeSeparation;
+
+    const float amplitude = static_cast<float>(m_amplitudeSum / m_amplitudes);
+    const float periodS   = 2.0f * static_cast<float>(m_lastCrossingTick - m_firstCrossingTick) * m_dt / static_cast<float>(m_amplitudes);
+
+    return Result{
+            // Closed velocity loop s^2 + (pole + kp gain) s + ki gain = (s + bandwidth)^2
+            .velocity     = {.kp = std::max(0.0f, (2.0f * velocityBandwidth - pole) / gain),
+                             .ki = velocityBandwidth * velocityBandwidth / gain,
+                             .kd = 0.0f},
+            // Against a fast velocity loop the angle is an integrator, a slow integral removes friction offsets
+            .angle        = {.kp = angleBandwidth, .ki = angleBandwidth * angleBandwidth / 10.0f, .kd = 0.0f},
+            .plantGain    = gain,
+            .plantPole    = pole,
+            .periodS      = periodS,
+            .ultimateGain = 4.0f * m_relayOutput / (fastMath::pi * amplitude),
+    };
+}
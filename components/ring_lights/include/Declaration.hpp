@@ -4,6 +4,7 @@
 #include <etl/array.h>
 #include <led_strip.h>
 
+#include "Angle.hpp"
 #include "freertos/FreeRTOS.h"
 
 namespace ringLights {
@@ -19,7 +20,7 @@ namespace ringLights {
         /**
          * @brief Approximate a point on an angle
          *
-         * @param param_a: [int] angle center of point in degrees
+         * @param param_a: [Angle] angle center of point
          * @param param_b: [int] angle of width of point in degrees
          *
          * @param primary_color: base color, fades at from center
@@ -29,7 +30,7 @@ namespace ringLights {
         /**
          * @brief Fills a bar around the smartknob from start to percentage
          *
-         * @param param_a: [int]  starting angle, between 180 and 359
+         * @param param_a: [Angle] starting angle, between 180 and 359 degrees
          * @param param_b: [int]  ending angle, between 0 and 179
          * @param param_c: [int]  percentage from 0 to 100
          *
@@ -48,7 +49,7 @@ namespace ringLights {
         /**
          * @brief Static gradient
          *
-         * @param param_a: [int]  gradient angle, between 0 and 359
+         * @param param_a: [Angle] gradient angle
          * @param param_b: [int]  gradient width, between 0 and 100 (percent)
          * @param param_c: [int]  gradient center, between 0 and 100 (percent) (0 corresponding to the bottom and 100 to the top)
          *
@@ -73,7 +74,7 @@ namespace ringLights {
         /**
          * @brief Moves a rainbow around the ring
          *
-         * @param param_a: [int] rotation per tick in degrees
+         * @param param_a: [Angle] rotation per tick, negative turns the other way
          */
         RAINBOW_RADIAL,
 
@@ -82,7 +83,7 @@ namespace ringLights {
 
     struct effectMsg {
         RingLightEffect effect = RAINBOW_UNIFORM;
-        double          paramA = 0.0f;
+        fastMath::Angle paramA{};
         int16_t         paramB = 0, paramC = 0;
         hsv_t           primaryColor{{0}, {0}, {0}}, secondaryColor{{0}, {0}, {0}};
     };
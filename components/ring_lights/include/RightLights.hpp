@@ -52,7 +52,7 @@ namespace ringLights {
 
         effectMsg m_currentEffect{
                 .effect         = RAINBOW_UNIFORM,
-                .paramA         = 0,
+                .paramA         = {},
                 .paramB         = 0,
                 .primaryColor   = {.h = 0, .s = 0, .v = 0},
                 .secondaryColor = {.h = 0, .s = 0, .v = 0}};
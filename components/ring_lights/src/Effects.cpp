@@ -1,25 +1,12 @@
 #include "../include/Effects.hpp"
 
-#include <math.h>
-
 #include <cmath>
 
+#include "FastMath.hpp"
 #include "esp_log.h"
 
 namespace ringLights {
 
-#define M_TAU (2 * M_PI)
-
-#define DEGREE_PER_LED (360.0 / NUM_LEDS)
-#define RAD_PER_LED (M_TAU / NUM_LEDS)
-
-// Reset an angle to between 0 and +inf
-#define WRAP_NEGATIVE_DEGREE(a) (a < 0.0f ? 360.0f + a : a)
-
-#define GET_SMALLEST_DEGREE_DIFFERENCE(a, b) (180.0f - fabs(abs(a - b) - 180.0f))
-
-#define DEGREE_TO_RADIAN(a) (a * M_PI / 180)
-
     // Just make sure to enter your angles in clockwise order
     int_fast16_t GET_CLOCKWISE_DIFF_DEGREES(int_fast16_t a, int_fast16_t b) {
         int_fast16_t diff = b - a;
@@ -40,28 +27,8 @@ namespace ringLights {
         return relativeAngle - relativeTotalWidth;
     }
 
-    template<typename T>
-    double GET_LED_ANGLE_DEGREES(T led) {
-        static_assert(std::is_arithmetic<T>::value);
-        double angle = static_cast<double>(led) * static_cast<double>(DEGREE_PER_LED);
-        if (angle < 0.0) {
-            angle = 360.0 + angle;
-        }
-        return angle;
-    }
-
-    template<typename T>
-    double GET_LED_ANGLE_RAD(T led) {
-        static_assert(std::is_arithmetic<T>::value);
-        // (M_PI / 2) because radians start on the right (90 degrees)
-        double angle = (led * RAD_PER_LED) + (M_PI / 2);
-        if (angle < 0) {
-            angle = M_TAU + angle;
-        }
-        if (angle > M_PI) {
-            angle = angle - M_TAU;
-        }
-        return angle;
+    fastMath::Angle GET_LED_ANGLE(int_fast16_t led) {
+        return fastMath::Angle::fromTurns(static_cast<float>(led) * (1.0f / NUM_LEDS));
     }
 
     bool HSV_IS_EQUAL(hsv_t a, hsv_t b) {
@@ -69,15 +36,13 @@ namespace ringLights {
     }
 
     void effects::pointer(rgb_t (&buffer)[NUM_LEDS], effectMsg& msg) {
-        auto angleDegrees           = WRAP_NEGATIVE_DEGREE(std::fmod(msg.paramA, 360.0));
         auto widthDegree            = static_cast<float>(msg.paramB);
         auto widthHalfPointerDegree = static_cast<float>(widthDegree) / 2.0f;
 
         hsv_t color = msg.primaryColor;
 
         for (int_fast8_t i = 0; i < NUM_LEDS; i++) {
-            float currentDegree   = static_cast<float>(i) * static_cast<float>(DEGREE_PER_LED);
-            float degreesToCenter = GET_SMALLEST_DEGREE_DIFFERENCE(angleDegrees, currentDegree);
+            float degreesToCenter = fastMath::abs(msg.paramA.degreesTo(GET_LED_ANGLE(i)));
             float progress        = 0.0f;
 
             if (degreesToCenter <= widthHalfPointerDegree) {
@@ -85,7 +50,7 @@ namespace ringLights {
             }
 
             if (0.1f <= progress && progress <= 1.0f) {
-                color.value = static_cast<uint8_t>(static_cast<double>(msg.primaryColor.value) * abs(progress));
+                color.value = static_cast<uint8_t>(static_cast<float>(msg.primaryColor.value) * progress);
             } else {
                 color.value = 0;
             }
@@ -96,27 +61,27 @@ namespace ringLights {
     }
 
     void effects::percent(rgb_t (&buffer)[NUM_LEDS], effectMsg& msg) {
-        int_fast16_t start = static_cast<int_fast16_t >(msg.paramA);
+        int_fast16_t start = static_cast<int_fast16_t>(msg.paramA.degrees());
         int_fast16_t end   = msg.paramB;
 
         // Scale `end` to percentage
-        double       percent    = static_cast<double>(msg.paramC) / 100;
+        float        percent    = static_cast<float>(msg.paramC) / 100.0f;
         int_fast16_t totalWidth = GET_CLOCKWISE_DIFF_DEGREES(start, end);
-        int_fast16_t correctEnd = start + (totalWidth * (percent));
+        int_fast16_t correctEnd = start + static_cast<int_fast16_t>(static_cast<float>(totalWidth) * percent);
         correctEnd %= 360;
 
-        double degreePerPercent = (totalWidth / 100.0);
+        float degreePerPercent = static_cast<float>(totalWidth) / 100.0f;
 
         // The vast majority of the LED's will be set using this colour, so avoid recalculating it for every LED
         rgb_t activeColor = hsv2rgb_rainbow(msg.primaryColor);
 
         for (int_fast8_t i = 0; i < NUM_LEDS; i++) {
-            auto currentDegree = static_cast<int_fast16_t>(std::round(GET_LED_ANGLE_DEGREES(i)));
+            auto currentDegree = static_cast<int_fast16_t>(std::lround(GET_LED_ANGLE(i).degrees()));
             auto remainder     = IS_BETWEEN_A_B_CLOCKWISE_DEGREES(start, correctEnd, currentDegree);
             if (remainder < 0 - degreePerPercent) {
                 buffer[i] = activeColor;
             } else if (remainder <= 0) {
-                auto value = static_cast<uint8_t>(std::round(static_cast<double>(msg.primaryColor.value) * (abs(remainder) / degreePerPercent)));
+                auto value = static_cast<uint8_t>(std::lround(static_cast<float>(msg.primaryColor.value) * (static_cast<float>(abs(remainder)) / degreePerPercent)));
                 buffer[i]  = hsv2rgb_rainbow({.h = msg.primaryColor.hue,
                                               .s = msg.primaryColor.sat,
                                               .v = value});
@@ -149,30 +114,28 @@ namespace ringLights {
             pSecondaryColor = msg.secondaryColor;
         }
 
-        double gradientAngle = std::fmod(static_cast<double>(msg.paramA), 360.0);
-
         // Divide by 50 so 100 percent covers the whole unit circle height
-        double gradientWidth = static_cast<double>(msg.paramB) / 50.0;
+        float gradientWidth = static_cast<float>(msg.paramB) / 50.0f;
         // Subtract 1 so 50 percent will be 0, which is the center y of the unit circle
-        double gradientCenter = (static_cast<double>(msg.paramC) / 50.0) - 1;
+        float gradientCenter = (static_cast<float>(msg.paramC) / 50.0f) - 1.0f;
 
         // Center is along the middle line, so upper and lower describe the start and
         // ending for both the left and the right side of the gradient on the circle
-        double upper = gradientCenter + (gradientWidth / 2);
-        double lower = gradientCenter - (gradientWidth / 2);
+        float upper = gradientCenter + (gradientWidth / 2.0f);
+        float lower = gradientCenter - (gradientWidth / 2.0f);
 
         for (int_fast16_t i = 0; i < NUM_LEDS; i++) {
-            double currentDegree = GET_LED_ANGLE_RAD(i);
-            currentDegree -= DEGREE_TO_RADIAN(gradientAngle);
-            double yPos = sin(currentDegree);
+            // A quarter turn because radians start on the right (90 degrees)
+            fastMath::Angle currentAngle = fastMath::quarterTurn + GET_LED_ANGLE(i) - msg.paramA;
+            float           yPos         = currentAngle.tableSin();
 
             if (yPos <= lower) {
                 buffer[i] = hsv2rgb_rainbow(msg.secondaryColor);
             } else if (yPos >= upper) {
                 buffer[i] = hsv2rgb_rainbow(msg.primaryColor);
             } else {
-                double progress = (yPos - lower) / gradientWidth;
-                buffer[i]       = hsv2rgb_rainbow(gradientBuffer[static_cast<int>(std::round(progress * (gradientResolution - 1)))]);
+                float progress = (yPos - lower) / gradientWidth;
+                buffer[i]      = hsv2rgb_rainbow(gradientBuffer[std::lround(progress * (gradientResolution - 1))]);
             }
         }
     }
@@ -215,11 +178,10 @@ namespace ringLights {
             }
         }
 
-        static int_fast16_t p_angle = 0;
-        p_angle                     = (p_angle + static_cast<int_fast16_t >(round(msg.paramA))) % 360;
-        p_angle                     = p_angle <= 0 ? p_angle + 360 : p_angle;
+        static fastMath::Angle p_angle;
+        p_angle += msg.paramA;
 
-        auto led_offset = static_cast<int_fast16_t>(p_angle / DEGREE_PER_LED) % NUM_LEDS;
+        auto led_offset = static_cast<int_fast16_t>(p_angle.turns() * NUM_LEDS) % NUM_LEDS;
 
         for (int_fast16_t i = 0; i < NUM_LEDS; i++) {
             buffer[i] = rainbow_buffer[(i + led_offset) % NUM_LEDS];
@@ -73,8 +73,8 @@ namespace ringLights {
     void RingLights::transitionEffect() {
         // As time goes on, the values in the new_effect_buffer will be weighted more
         // heavily. This is nonlinear because human eyes aren't either.
-        double transition_progress = ((double) EFFECT_TRANSITION_TICKS - m_effectTransitionTicksLeft) / (double) EFFECT_TRANSITION_TICKS * 100;
-        transition_progress        = std::max((double) 0, (std::log(transition_progress) / 2) + 1) * 255;
+        float transition_progress = ((float) EFFECT_TRANSITION_TICKS - m_effectTransitionTicksLeft) / (float) EFFECT_TRANSITION_TICKS * 100;
+        transition_progress       = std::max(0.0f, (std::log(transition_progress) / 2) + 1) * 255;
         ESP_LOGV(TAG, "transition_progress %f - %lu", transition_progress, m_effectTransitionTicksLeft);
 
         for (uint8_t i = 0; i < NUM_LEDS; i++) {
@@ -0,0 +1,65 @@
+#ifndef FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_HX711SPI_HPP
+#define FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_HX711SPI_HPP
+
+#include <driver/spi_master.h>
+#include <hx711.h>
+
+#include <atomic>
+#include <cstdint>
+#include <system_error>
+
+#include "esp_attr.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief HX711 readout by an SPI host instead of bit-banging
+ *
+ * The HX711 shifts a bit out on every rising PD_SCK edge and holds it through the falling edge, which is
+ * SPI mode 1 with PD_SCK as SCLK and DOUT as MISO. One receive-only transaction of 25 to 27 bits clocks
+ * out the 24 bit sample and the gain pulses, the SPI peripheral generates every edge and the task waits
+ * for the completion interrupt without masking anything.
+ */
+class Hx711Spi {
+public:
+    /**
+     * @brief Takes over PD_SCK and DOUT, call after hx711_init() powered the HX711 up
+     * @return ESP_ERR_INVALID_STATE when the SPI host is already used by another component
+     */
+    std::error_code initialize(const hx711_t& device);
+
+    /**
+     * @brief Releases the SPI host and hands PD_SCK back to the GPIO driver, so hx711_power_down() works again
+     */
+    void stop();
+
+    bool initialized() const { return m_device != nullptr; }
+
+    /**
+     * @brief Clocks out a sample, blocks the calling task until the transaction completes
+     * @return esp_err_t on error
+     */
+    std::error_code read(int32_t& value);
+
+    /**
+     * @brief CPU cycles the last readout spent in SPI interrupts: from the interrupt that started the
+     *        transaction to the end of the one that completed it, less the time the bits take on the wire
+     */
+    uint32_t lastInterruptCycles() const { return m_interruptCycles.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr auto     m_host       = static_cast<spi_host_device_t>(CONFIG_STRAIN_SENSOR_SPI_BUS);
+    static constexpr uint32_t m_clockSpeed = CONFIG_STRAIN_SENSOR_SPI_CLOCK_SPEED;
+
+    // Both run inside the SPI interrupt
+    static void IRAM_ATTR onTransactionStart(spi_transaction_t* transaction);
+    static void IRAM_ATTR onTransactionDone(spi_transaction_t* transaction);
+
+    spi_device_handle_t   m_device = nullptr;
+    gpio_num_t            m_pdSck  = GPIO_NUM_NC;
+    spi_transaction_t     m_transaction{};
+    uint32_t              m_wireCycles  = 0;
+    uint32_t              m_startCycles = 0;
+    std::atomic<uint32_t> m_interruptCycles{0};
+};
+
+#endif // FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_HX711SPI_HPP
@@ -0,0 +1,138 @@
+#ifndef FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_PRESSENGINE_HPP
+#define FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_PRESSENGINE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "sdkconfig.h"
+
+/**
+ * @brief Turns the strain sample stream into debounced, timestamped press events
+ *
+ * Runs once per sample on the task that reads the sensor. Deflection is measured from a baseline that
+ * follows slow drift while the knob is released. A level is entered when the deflection crosses its
+ * threshold and only left once it falls a hysteresis band below it, and a change of level only counts
+ * once it held for the debounce time. Events go into a queue any task can take them from.
+ */
+class PressEngine {
+public:
+    enum class Level : uint8_t {
+        RELEASED,
+        LIGHT,
+        HARD
+    };
+
+    enum class EventType : uint8_t {
+        PRESS,        ///< Light threshold crossed
+        RELEASE,      ///< Back below the light threshold
+        LONG_PRESS,   ///< Held for CONFIG_STRAIN_SENSOR_LONG_PRESS_MS
+        DOUBLE_PRESS, ///< Second press shortly after a short one, follows its PRESS event
+        HARD_PRESS    ///< Hard threshold crossed, from light or straight from released
+    };
+
+    struct Event {
+        EventType type;
+        uint32_t  durationMs; ///< Time since the press started, for RELEASE and LONG_PRESS
+        int64_t   timestamp;  ///< esp_timer time of the sample that caused the event, in microseconds
+    };
+
+    /**
+     * @brief Calibrated raw values of each level and the noise standard deviation
+     */
+    struct Calibration {
+        int32_t resting;
+        int32_t light;
+        int32_t hard;
+        int32_t noise;
+    };
+
+    struct LatencyStats {
+        uint32_t events;  ///< Events queued
+        uint32_t dropped; ///< Events lost to a full queue
+        uint32_t lastUs;  ///< Sample to queue
+        uint32_t maxUs;
+    };
+
+    /**
+     * @brief Sets new thresholds, safe to call from any task, they apply from the next sample on
+     */
+    void setCalibration(const Calibration& calibration) { xQueueOverwrite(m_calibrationMailbox, &calibration); }
+
+    /**
+     * @brief Feeds one sample, only called by the task reading the sensor
+     */
+    void process(int32_t value, int64_t timestamp);
+
+    /**
+     * @brief Takes the oldest event from the queue
+     * @param timeout Ticks to wait for one, 0 to return right away
+     * @return False when there was none
+     */
+    bool receive(Event& event, const TickType_t timeout = 0) { return xQueueReceive(m_eventQueue, &event, timeout) == pdTRUE; }
+
+    /**
+     * @brief Debounced level, safe to call from any task
+     */
+    Level level() const { return m_level.load(std::memory_order_relaxed); }
+
+    LatencyStats latencyStats() const;
+
+private:
+    static constexpr size_t  m_eventQueueLength = 16;
+    static constexpr int64_t m_debounceUs       = CONFIG_STRAIN_SENSOR_DEBOUNCE_MS * 1000;
+    static constexpr int64_t m_longPressUs      = CONFIG_STRAIN_SENSOR_LONG_PRESS_MS * 1000;
+    static constexpr int64_t m_doublePressUs    = CONFIG_STRAIN_SENSOR_DOUBLE_PRESS_MS * 1000;
+    static constexpr float   m_hysteresisSigmas = CONFIG_STRAIN_SENSOR_PRESS_HYSTERESIS;
+    // Baseline follows 1/2^n of the difference per released sample, in 16.16 fixed point
+    static constexpr int m_baselineShift = 8;
+
+    // Newest calibration, picked up by process(), and the events it produced
+    StaticQueue_t                                           m_calibrationMailboxBuffer{};
+    std::array<uint8_t, sizeof(Calibration)>                m_calibrationMailboxStorage{};
+    QueueHandle_t                                           m_calibrationMailbox = xQueueCreateStatic(1, sizeof(Calibration),
+                                                                                                      m_calibrationMailboxStorage.data(), &m_calibrationMailboxBuffer);
+    StaticQueue_t                                           m_eventQueueBuffer{};
+    std::array<uint8_t, m_eventQueueLength * sizeof(Event)> m_eventQueueStorage{};
+    QueueHandle_t                                           m_eventQueue = xQueueCreateStatic(m_eventQueueLength, sizeof(Event),
+                                                                                              m_eventQueueStorage.data(), &m_eventQueueBuffer);
+
+    // Only touched by process()
+    bool    m_calibrated     = false;
+    int32_t m_direction      = 1; // Sign of a press in raw values
+    float   m_lightOffset    = 0.0f;
+    float   m_hardOffset     = 0.0f;
+    float   m_hysteresis     = 0.0f;
+    int64_t m_baseline       = 0; // 16.16 fixed point raw value
+    Level   m_candidate      = Level::RELEASED;
+    int64_t m_candidateSince = 0;
+    int64_t m_pressStart     = 0;
+    int64_t m_lastRelease    = INT64_MIN / 2;
+    bool    m_lastWasShort   = false;
+    bool    m_longSent       = false;
+    bool    m_doubleSent     = false;
+
+    std::atomic<Level>    m_level{Level::RELEASED};
+    std::atomic<uint32_t> m_events{0};
+    std::atomic<uint32_t> m_dropped{0};
+    std::atomic<uint32_t> m_lastLatencyUs{0};
+    std::atomic<uint32_t> m_maxLatencyUs{0};
+
+    void applyCalibration(const Calibration& calibration);
+
+    /**
+     * @brief Level the deflection points to, with hysteresis around the current level
+     */
+    Level classify(float deflection) const;
+
+    /**
+     * @brief Emits the events for a debounced change of level
+     */
+    void commit(Level level, int64_t timestamp);
+
+    void emit(EventType type, int64_t timestamp, int64_t sinceUs);
+};
+
+#endif // FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_PRESSENGINE_HPP
@@ -0,0 +1,53 @@
+#ifndef FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_RUNNINGSTATS_HPP
+#define FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_RUNNINGSTATS_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Streaming mean and variance (Welford), constant memory however many samples are added
+ *
+ * Samples are accumulated relative to the first one, so single precision keeps its resolution on the
+ * large raw HX711 values and the variance does not suffer from cancellation.
+ */
+class RunningStats {
+public:
+    void add(const int32_t value) {
+        if (m_count == 0) {
+            m_origin = value;
+        }
+        const float x     = static_cast<float>(value - m_origin);
+        const float delta = x - m_mean;
+        m_count++;
+        m_mean += delta / static_cast<float>(m_count);
+        m_m2 += delta * (x - m_mean);
+    }
+
+    size_t count() const { return m_count; }
+
+    float mean() const { return static_cast<float>(m_origin) + m_mean; }
+
+    /**
+     * @brief Sample variance, 0 below two samples
+     */
+    float variance() const { return m_count > 1 ? m_m2 / static_cast<float>(m_count - 1) : 0.0f; }
+
+    float standardDeviation() const { return std::sqrt(variance()); }
+
+    /**
+     * @brief Half width of the confidence interval of the mean
+     * @param z Standard scores wide, 1.96 for 95%
+     */
+    float meanHalfWidth(const float z) const {
+        return m_count > 1 ? z * standardDeviation() / std::sqrt(static_cast<float>(m_count)) : INFINITY;
+    }
+
+private:
+    size_t  m_count  = 0;
+    int32_t m_origin = 0;
+    float   m_mean   = 0.0f;
+    float   m_m2     = 0.0f;
+};
+
+#endif // FIRMWARE_COMPONENTS_STRAIN_SENSOR_INCLUDE_RUNNINGSTATS_HPP
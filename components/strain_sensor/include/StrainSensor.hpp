@@ -3,12 +3,28 @@
 
 #include <hx711.h>
 
-#include "simple_lowpass_filter.hpp"
-
 #include "Component.hpp"
 #include "ConfigProvider.hpp"
+#include "HistoryBuffer.hpp"
+#include "PressEngine.hpp"
+#include "RunningStats.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+#include "Hx711Spi.hpp"
+#endif
+
+#include <atomic>
 
 /**
+ * @brief HX711 load cell behind the knob, sampled in the background
+ *
+ * DOUT falls when a conversion is ready. That edge wakes a reader task, which clocks the sample out,
+ * timestamps it and pushes it into a ring buffer. All reads take samples from the ring, so no caller
+ * ever waits on the HX711.
+ *
  * @note hx711 datasheet: https://cdn.sparkfun.com/datasheets/Sensors/ForceFlex/hx711_english.pdf
  */
 
@@ -65,7 +81,7 @@ public:
         }
     ){};
 
-    enum CalibrationState {
+    enum CalibrationState : uint8_t {
         INACTIVE,
         WAITING_FOR_THRESHOLD_PASS,
         ACTIVE,
@@ -73,11 +89,46 @@ public:
         ERROR
     };
 
+    /**
+     * @brief Calibration steps in the order they run
+     */
+    enum CalibrationStep : uint8_t {
+        NOISE,
+        RESTING_VALUE,
+        LIGHT_PRESS_VALUE,
+        HARD_PRESS_VALUE
+    };
+
+    struct CalibrationProgress {
+        CalibrationState state;
+        CalibrationStep  step;
+        /// Waiting: how close the press is to the threshold. Active: how far the step is to converging.
+        uint8_t percentage;
+        uint8_t retries; ///< Times the step measured a press too light to tell apart from the level below
+    };
+
     struct StrainState {
         StrainLevel level;
         uint8_t     percentage;
     };
 
+    struct Sample {
+        int32_t value;
+        int64_t timestamp; ///< esp_timer time DOUT signalled the conversion was ready, in microseconds
+    };
+
+    /**
+     * @brief Cost of clocking samples out, as CPU time the readout takes from everything else on the
+     *        reading core. Bit-banged that is the readout itself, spent with interrupts masked. Over SPI
+     *        nothing is masked, it is the time spent in the transaction's interrupts.
+     */
+    struct ReadoutStats {
+        bool     spi;       ///< Clocked out by the SPI host rather than bit-banged
+        uint32_t reads;
+        uint32_t lastCpuNs;
+        uint32_t maxCpuNs;
+    };
+
     static inline const etl::array<etl::string<15>, static_cast<uint8_t>(StrainLevel::MAX)> LevelToString{
     "",
             "resting",
@@ -98,20 +149,45 @@ public:
     bool needsFirstTimeSetup() { return m_config.isDefault(); }
 
     /**
-     * @brief Checks current strain level against those saved in configuration
+     * @brief Debounced press level and how far the newest sample is from the resting value
      * @return pressState, esp_err_t on error
      */
     std::expected<StrainState, std::error_code> getPressState();
 
     /**
-     * @brief Blocking function that waits for the sensor to become ready and read
+     * @brief Debounced press level alone, a single atomic load and safe to call from any task
+     */
+    PressEngine::Level getPressLevel() const { return m_pressEngine.level(); }
+
+    /**
+     * @brief Takes the oldest press event, safe to call from any task
+     * @param timeout Ticks to wait for an event, 0 to return right away
+     * @return False when there was none
+     */
+    bool receivePressEvent(PressEngine::Event& event, const TickType_t timeout = 0) { return m_pressEngine.receive(event, timeout); }
+
+    /**
+     * @brief Number of press events and their latency from the sample to the queue
+     */
+    PressEngine::LatencyStats getPressLatencyStats() const { return m_pressEngine.latencyStats(); }
+
+    ReadoutStats getReadoutStats() const;
+
+    /**
+     * @brief Newest sample, does not block
+     * @return Sample, ESP_ERR_TIMEOUT when the sensor stopped delivering samples
+     */
+    std::expected<Sample, std::error_code> getLatestSample() const;
+
+    /**
+     * @brief Value of the newest sample, does not block
      * @return int32_t, esp_err_t on error
      */
     std::expected<int32_t, std::error_code> readStrainLevel();
 
     /**
-     * @brief Blocking function that waits for the sensor to become ready and read
-     * @param samples Number of times to read from the sensor for the average
+     * @brief Blocking function that waits for new samples and averages them
+     * @param samples Number of new samples to average
      * @return int32_t, esp_err_t on error
      */
     std::expected<int32_t, std::error_code> readAverageStrainLevel(size_t samples);
@@ -129,33 +205,145 @@ public:
     std::error_code resetConfig();
 
     /**
-     * @brief Calibrate configuration settings for noise value of strain sensor
-     * @param save Whether to immediately save new value to flash
-     * @return esp_err_t on error
+     * @brief Starts calibrating every value and saves them once done, does not block
+     *
+     * run() advances the calibration on every new sample: the noise, the resting value, then the light
+     * and hard press values, each waiting for the user to press past the level below first. The noise
+     * step samples until its deviation settles to within m_noiseTolerance, the levels until their value
+     * is known to within m_levelTolerance. Restarts a calibration that is still running.
+     *
+     * @return ESP_ERR_INVALID_STATE when the sensor is not running
      */
-    std::error_code calibrateNoiseValue(bool save = false);
+    std::error_code startCalibration();
 
     /**
-     * @brief Returns calibration state when calibrating
-     * @return
+     * @brief Returns calibration state, safe to call from any task
+     * @return CalibrationState, the error that stopped calibration
      */
-    std::expected<CalibrationState, std::error_code> getCalibrationState();
+    std::expected<CalibrationState, std::error_code> getCalibrationState() const;
 
-    void calibrateValue(StrainSensor::StrainLevel strainLevel, bool save = false);
+    /**
+     * @brief Current calibration step and its progress, safe to call from any task
+     */
+    CalibrationProgress getCalibrationProgress() const { return m_calibrationProgress.load(std::memory_order_acquire); }
 
 private:
     static constexpr char TAG[] = "Strain sensor";
 
+    // About 6 seconds at 10 samples per second
+    static constexpr size_t  m_sampleRingLength = 64;
+    static constexpr int64_t m_sampleTimeoutUs  = CONFIG_STRAIN_SENSOR_SAMPLE_TIMEOUT_MS * 1000;
+
+    // Noise calibration stops once the running deviation moved by less than m_noiseTolerance over the
+    // last window of samples, levels once the 95% confidence interval of their mean is this tight. Either
+    // stops after CONFIG_STRAIN_SENSOR_NUM_CALIBRATION_MEASUREMENTS samples.
+    static constexpr float  m_confidenceZ           = 1.96f;
+    static constexpr size_t m_minCalibrationSamples = 20;
+    static constexpr size_t m_noiseWindow           = 20;
+    static constexpr float  m_noiseTolerance        = 0.03f; // Relative to the noise itself
+    static constexpr float  m_levelTolerance        = 0.25f; // In noise standard deviations
+    // Levels are set apart by multiples of this many standard deviations, about the min/max range of
+    // a thousand samples of noise, which used to be the noise value
+    static constexpr int32_t m_noiseSigmas = 6;
+
     Status           m_status            = Status::UNINITIALIZED;
-    CalibrationState m_calibrationStatus = CalibrationState::INACTIVE;
-    std::error_code  m_calibrationError  = std::make_error_code(ESP_OK);
     Config           m_config;
     int32_t          m_restingStateNoise = 0;
-    float            m_filteredRestingLevel = 0;
-
-    espp::SimpleLowpassFilter m_restingFilter;
 
     hx711_t m_hx711_dev;
+
+    HistoryBuffer<Sample, m_sampleRingLength> m_samples;
+    PressEngine                               m_pressEngine;
+    TaskHandle_t                              m_readerTask = nullptr;
+    std::atomic<bool>                         m_runReader{false};
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+    Hx711Spi m_spiReadout;
+#endif
+    std::atomic<uint32_t> m_reads{0};
+    std::atomic<uint32_t> m_lastCpuCycles{0};
+    std::atomic<uint32_t> m_maxCpuCycles{0};
+    // Low 32 bits of the esp_timer time of the last DOUT edge, a 64-bit store could tear between the
+    // interrupt and the reader task. Widened again against the reader's clock, fine for gaps under 71 minutes.
+    std::atomic<uint32_t> m_readyUs{0};
+
+    // Calibration is requested by any task and only advanced by run()
+    struct CalibrationRun {
+        CalibrationStep step;
+        uint8_t         retries;
+        RunningStats    stats;
+        float           windowDeviation; ///< Standard deviation at the end of the previous noise window
+        uint32_t        cursor;
+        int64_t         stepStart;     ///< esp_timer time the step started sampling
+        int64_t         firstSampleUs; ///< Timestamps of the first and last sample of the step
+        int64_t         lastSampleUs;
+        int64_t         lastArrival;   ///< esp_timer time run() last saw a new sample
+    };
+    CalibrationRun                   m_calibrationRun{};
+    std::atomic<bool>                m_calibrationRequested{false};
+    std::atomic<CalibrationProgress> m_calibrationProgress{{CalibrationState::INACTIVE, CalibrationStep::NOISE, 0, 0}};
+    std::atomic<esp_err_t>           m_calibrationError{ESP_OK};
+
+    static void IRAM_ATTR onDataReady(void* _this);
+    static void           startReader(void* _this);
+
+    /**
+     * @brief Clocks out a sample every time DOUT signals one is ready and runs it through the press
+     *        engine, until stop()
+     */
+    void readerTask();
+
+    /**
+     * @brief Ends the reader task and waits until it deleted itself, no-op when it is not running
+     */
+    void stopReader();
+
+    /**
+     * @brief Undoes a partial initialize(): interrupt handler, reader task and SPI readout
+     */
+    Status failInitialize();
+
+    /**
+     * @brief Clocks out the sample DOUT signalled, through the SPI host when it could be set up
+     */
+    std::error_code readout(int32_t& value);
+
+    /**
+     * @brief Hands the configured levels to the press engine
+     */
+    void updatePressCalibration();
+
+    /**
+     * @brief Feeds the samples pushed since the last call to the running calibration, called by run()
+     */
+    void advanceCalibration();
+
+    /**
+     * @brief One calibration sample, moves on to the next state once the current one is done
+     */
+    void calibrationSample(const Sample& sample);
+
+    /**
+     * @brief Starts a step, waiting for the press to pass the level below first where there is one
+     */
+    void beginCalibrationStep(CalibrationStep step, uint8_t retries = 0);
+
+    /**
+     * @brief Stores the value the step converged on, or sends the user back to press harder
+     */
+    void finishCalibrationStep();
+
+    void failCalibration(esp_err_t err);
+
+    void publishCalibration(CalibrationState state, uint8_t percentage) {
+        m_calibrationProgress.store({state, m_calibrationRun.step, percentage, m_calibrationRun.retries}, std::memory_order_release);
+    }
+
+    /**
+     * @brief Raw value a press has to exceed to calibrate the given level
+     */
+    int32_t calibrationThreshold(StrainLevel level) const {
+        return m_config.getStrainValue(static_cast<StrainLevel>(level - 1)) + m_noiseSigmas * m_restingStateNoise * level;
+    }
 };
 
 #endif /* strain_sensor_HPP */
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+#include "Hx711Spi.hpp"
+
+#include "esp_cpu.h"
+#include "esp_system_error.hpp"
+
+std::error_code Hx711Spi::initialize(const hx711_t& device) {
+    const spi_bus_config_t busConfig{
+            .mosi_io_num     = -1,
+            .miso_io_num     = device.dout,
+            .sclk_io_num     = device.pd_sck,
+            .quadwp_io_num   = -1,
+            .quadhd_io_num   = -1,
+            .max_transfer_sz = 4,
+    };
+    if (const auto err = spi_bus_initialize(m_host, &busConfig, SPI_DMA_DISABLED)) {
+        return std::make_error_code(err);
+    }
+
+    // Mode 1: SCLK idles low like PD_SCK has to, bits are sampled on the falling edge
+    const spi_device_interface_config_t deviceConfig{
+            .mode           = 1,
+            .clock_speed_hz = static_cast<int>(m_clockSpeed),
+            .spics_io_num   = -1,
+            .queue_size     = 1,
+            .pre_cb         = onTransactionStart,
+            .post_cb        = onTransactionDone,
+    };
+    if (const auto err = spi_bus_add_device(m_host, &deviceConfig, &m_device)) {
+        spi_bus_free(m_host);
+        return std::make_error_code(err);
+    }
+
+    // 24 data bits, then 1 to 3 more pulses select the gain of the next conversion
+    const size_t bits = 24 + (device.gain == HX711_GAIN_A_128 ? 1 : device.gain == HX711_GAIN_B_32 ? 2 : 3);
+    m_transaction = {
+            .flags    = SPI_TRANS_USE_RXDATA,
+            .length   = bits,
+            .rxlength = bits,
+            .user     = this,
+    };
+    m_wireCycles = static_cast<uint32_t>(static_cast<uint64_t>(bits) * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000 / m_clockSpeed);
+    m_pdSck      = device.pd_sck;
+    return {};
+}
+
+void Hx711Spi::stop() {
+    if (m_device == nullptr) {
+        return;
+    }
+    spi_bus_remove_device(m_device);
+    spi_bus_free(m_host);
+    m_device = nullptr;
+
+    // Route PD_SCK back to its GPIO output register
+    gpio_reset_pin(m_pdSck);
+    gpio_set_direction(m_pdSck, GPIO_MODE_OUTPUT);
+    gpio_set_level(m_pdSck, 0);
+}
+
+std::error_code Hx711Spi::read(int32_t& value) {
+    if (const auto err = spi_device_transmit(m_device, &m_transaction)) {
+        return std::make_error_code(err);
+    }
+
+    // MSB first, two's complement
+    const auto& rx  = m_transaction.rx_data;
+    const auto  raw = (static_cast<uint32_t>(rx[0]) << 16) | (static_cast<uint32_t>(rx[1]) << 8) | rx[2];
+    value           = static_cast<int32_t>(raw << 8) >> 8;
+    return {};
+}
+
+void IRAM_ATTR Hx711Spi::onTransactionStart(spi_transaction_t* transaction) {
+    static_cast<Hx711Spi*>(transaction->user)->m_startCycles = esp_cpu_get_cycle_count();
+}
+
+void IRAM_ATTR Hx711Spi::onTransactionDone(spi_transaction_t* transaction) {
+    auto*          spi     = static_cast<Hx711Spi*>(transaction->user);
+    const uint32_t elapsed = esp_cpu_get_cycle_count() - spi->m_startCycles;
+    spi->m_interruptCycles.store(elapsed > spi->m_wireCycles ? elapsed - spi->m_wireCycles : 0, std::memory_order_relaxed);
+}
+#endif
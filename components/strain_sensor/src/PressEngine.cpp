@@ -0,0 +1,131 @@
+#include "PressEngine.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "esp_timer.h"
+
+void PressEngine::process(const int32_t value, const int64_t timestamp) {
+    if (Calibration calibration; xQueueReceive(m_calibrationMailbox, &calibration, 0) == pdTRUE) {
+        applyCalibration(calibration);
+    }
+    if (!m_calibrated) {
+        return;
+    }
+
+    const int64_t fixedValue = static_cast<int64_t>(value) << 16;
+    const float   deflection = static_cast<float>(fixedValue - m_baseline) * (1.0f / 65536.0f) * static_cast<float>(m_direction);
+    const Level   current    = m_level.load(std::memory_order_relaxed);
+    const Level   target     = classify(deflection);
+
+    if (target == current) {
+        m_candidate = current;
+        // Only follow drift while nothing presses on the knob
+        if (current == Level::RELEASED) {
+            m_baseline += (fixedValue - m_baseline) >> m_baselineShift;
+        }
+    } else {
+        if (target != m_candidate) {
+            m_candidate      = target;
+            m_candidateSince = timestamp;
+        }
+        if (timestamp - m_candidateSince >= m_debounceUs) {
+            commit(target, timestamp);
+        }
+    }
+
+    if (m_level.load(std::memory_order_relaxed) != Level::RELEASED && !m_longSent && timestamp - m_pressStart >= m_longPressUs) {
+        m_longSent = true;
+        emit(EventType::LONG_PRESS, timestamp, m_pressStart);
+    }
+}
+
+PressEngine::LatencyStats PressEngine::latencyStats() const {
+    return {
+            .events  = m_events.load(std::memory_order_relaxed),
+            .dropped = m_dropped.load(std::memory_order_relaxed),
+            .lastUs  = m_lastLatencyUs.load(std::memory_order_relaxed),
+            .maxUs   = m_maxLatencyUs.load(std::memory_order_relaxed),
+    };
+}
+
+void PressEngine::applyCalibration(const Calibration& calibration) {
+    for (const int32_t value : {calibration.resting, calibration.light, calibration.hard, calibration.noise}) {
+        if (value == INT32_MAX) {
+            m_calibrated = false;
+            return;
+        }
+    }
+
+    m_direction   = calibration.light >= calibration.resting ? 1 : -1;
+    m_lightOffset = static_cast<float>(std::abs(calibration.light - calibration.resting));
+    m_hardOffset  = std::max(m_lightOffset, static_cast<float>(std::abs(calibration.hard - calibration.resting)));
+    // The bands never reach back past the level below
+    m_hysteresis = std::min({m_hysteresisSigmas * static_cast<float>(calibration.noise), m_lightOffset / 2.0f,
+                             (m_hardOffset - m_lightOffset) / 2.0f});
+    m_baseline   = static_cast<int64_t>(calibration.resting) << 16;
+    m_calibrated = true;
+}
+
+PressEngine::Level PressEngine::classify(const float deflection) const {
+    switch (m_level.load(std::memory_order_relaxed)) {
+        case Level::RELEASED:
+            if (deflection > m_hardOffset) {
+                return Level::HARD;
+            }
+            return deflection > m_lightOffset ? Level::LIGHT : Level::RELEASED;
+        case Level::LIGHT:
+            if (deflection > m_hardOffset) {
+                return Level::HARD;
+            }
+            return deflection < m_lightOffset - m_hysteresis ? Level::RELEASED : Level::LIGHT;
+        case Level::HARD:
+        default:
+            if (deflection < m_lightOffset - m_hysteresis) {
+                return Level::RELEASED;
+            }
+            return deflection < m_hardOffset - m_hysteresis ? Level::LIGHT : Level::HARD;
+    }
+}
+
+void PressEngine::commit(const Level level, const int64_t timestamp) {
+    const Level previous = m_level.load(std::memory_order_relaxed);
+    m_level.store(level, std::memory_order_relaxed);
+
+    if (previous == Level::RELEASED) {
+        m_pressStart = timestamp;
+        m_longSent   = false;
+        m_doubleSent = m_lastWasShort && timestamp - m_lastRelease <= m_doublePressUs;
+        emit(EventType::PRESS, timestamp, timestamp);
+        if (m_doubleSent) {
+            emit(EventType::DOUBLE_PRESS, timestamp, timestamp);
+        }
+        if (level == Level::HARD) {
+            emit(EventType::HARD_PRESS, timestamp, m_pressStart);
+        }
+    } else if (level == Level::RELEASED) {
+        emit(EventType::RELEASE, timestamp, m_pressStart);
+        m_lastRelease = timestamp;
+        // The press that completed a double press cannot start another one
+        m_lastWasShort = !m_longSent && !m_doubleSent;
+    } else if (level == Level::HARD) {
+        emit(EventType::HARD_PRESS, timestamp, m_pressStart);
+    }
+}
+
+void PressEngine::emit(const EventType type, const int64_t timestamp, const int64_t sinceUs) {
+    const Event event{
+            .type       = type,
+            .durationMs = static_cast<uint32_t>((timestamp - sinceUs) / 1000),
+            .timestamp  = timestamp,
+    };
+    if (xQueueSend(m_eventQueue, &event, 0) != pdTRUE) {
+        m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    const auto latency = static_cast<uint32_t>(esp_timer_get_time() - timestamp);
+    m_lastLatencyUs.store(latency, std::memory_order_relaxed);
+    m_maxLatencyUs.store(std::max(latency, m_maxLatencyUs.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    m_events.store(m_events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
@@ -2,11 +2,14 @@
 
 #include <lowpass_filter.hpp>
 
+#include <algorithm>
 #include <cmath>
 
+#include "esp_cpu.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_system_error.hpp"
+#include "esp_timer.h"
 
 using Status = sdk::Component::Status;
 
@@ -67,13 +70,80 @@ Status StrainSensor::initialize() {
         return m_status = Status::ERROR;
     }
 
-    // Average filter resting value over 30 minutes
-    m_restingFilter.set_time_constant(1800);
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+    // Both general purpose SPI hosts may already drive the display and the encoder
+    if (const auto err = m_spiReadout.initialize(m_hx711_dev)) {
+        ESP_LOGW(TAG, "SPI readout unavailable, bit-banging the HX711: %s", err.message().c_str());
+    } else {
+        ESP_LOGI(TAG, "Clocking the HX711 out with SPI host %d", CONFIG_STRAIN_SENSOR_SPI_BUS);
+    }
+#endif
+
+    if (m_config.strainNoiseValue.value() != INT32_MAX) {
+        m_restingStateNoise = m_config.strainNoiseValue.value();
+    }
+    updatePressCalibration();
+
+    // The handler is added with the edge interrupt still off, it only fires once the reader task exists.
+    // The service may already be installed by another component.
+    if (const esp_err_t err = gpio_install_isr_service(0); err && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to install GPIO interrupt service: %s", esp_err_to_name(err));
+        return failInitialize();
+    }
+    for (const esp_err_t err : {
+                 gpio_set_intr_type(m_hx711_dev.dout, GPIO_INTR_NEGEDGE),
+                 gpio_isr_handler_add(m_hx711_dev.dout, onDataReady, this),
+         }) {
+        if (err) {
+            ESP_LOGE(TAG, "Failed to set up DOUT interrupt: %s", esp_err_to_name(err));
+            return failInitialize();
+        }
+    }
+
+    m_runReader = true;
+    if (xTaskCreatePinnedToCore(startReader, "HX711", 3072, this, 10, &m_readerTask, 0) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create HX711 reader task");
+        m_readerTask = nullptr;
+        return failInitialize();
+    }
+
+    if (const esp_err_t err = gpio_intr_enable(m_hx711_dev.dout)) {
+        ESP_LOGE(TAG, "Failed to enable DOUT interrupt: %s", esp_err_to_name(err));
+        return failInitialize();
+    }
 
     return m_status = Status::RUNNING;
 }
 
+Status StrainSensor::failInitialize() {
+    gpio_intr_disable(m_hx711_dev.dout);
+    gpio_isr_handler_remove(m_hx711_dev.dout);
+    stopReader();
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+    m_spiReadout.stop();
+#endif
+    return m_status = Status::ERROR;
+}
+
+void StrainSensor::stopReader() {
+    m_runReader = false;
+    if (m_readerTask == nullptr) {
+        return;
+    }
+    xTaskNotifyGive(m_readerTask);
+    // The task clears its handle right before it deletes itself
+    while (m_readerTask != nullptr) {
+        vTaskDelay(1);
+    }
+}
+
 Status StrainSensor::stop() {
+    gpio_isr_handler_remove(m_hx711_dev.dout);
+    stopReader();
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+    m_spiReadout.stop();
+#endif
+
     if (const auto err = hx711_power_down(&m_hx711_dev, true)) {
         ESP_LOGE(TAG, "Failed to power down device: %s", esp_err_to_name(err));
         return m_status = Status::ERROR;
@@ -83,13 +153,105 @@ Status StrainSensor::stop() {
 }
 
 Status StrainSensor::run() {
-    if (const auto val = readStrainLevel(); val.has_value()) {
-        m_filteredRestingLevel = m_restingFilter.update(val.value());
-    }
+    advanceCalibration();
 
     return m_status;
 }
 
+void IRAM_ATTR StrainSensor::onDataReady(void* _this) {
+    auto* sensor = static_cast<StrainSensor*>(_this);
+    sensor->m_readyUs.store(static_cast<uint32_t>(esp_timer_get_time()), std::memory_order_relaxed);
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(sensor->m_readerTask, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void StrainSensor::startReader(void* _this) {
+    auto* sensor = static_cast<StrainSensor*>(_this);
+    sensor->readerTask();
+    sensor->m_readerTask = nullptr;
+    vTaskDelete(nullptr);
+}
+
+void StrainSensor::readerTask() {
+    bool timedOut = false;
+    while (m_runReader) {
+        // A missed edge only costs one timeout, DOUT stays low until the sample is read
+        const bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_STRAIN_SENSOR_SAMPLE_TIMEOUT_MS)) > 0;
+        if (!m_runReader) {
+            break;
+        }
+        bool ready = false;
+        hx711_is_ready(&m_hx711_dev, &ready);
+        if (!ready) {
+            // Log once per outage, not once per timeout
+            if (!notified && !timedOut) {
+                ESP_LOGW(TAG, "No sample from the HX711 within %d ms", CONFIG_STRAIN_SENSOR_SAMPLE_TIMEOUT_MS);
+                timedOut = true;
+            }
+            continue;
+        }
+
+        int64_t timestamp = esp_timer_get_time();
+        if (notified) {
+            // The notification orders the interrupt's store before this load
+            timestamp -= static_cast<uint32_t>(static_cast<uint32_t>(timestamp) - m_readyUs.load(std::memory_order_relaxed));
+        }
+        int32_t       value     = 0;
+        if (const auto err = readout(value)) {
+            ESP_LOGE(TAG, "Failed read to strain sensor value: %s", err.message().c_str());
+            continue;
+        }
+        m_samples.push({.value = value, .timestamp = timestamp});
+        m_pressEngine.process(value, timestamp);
+        timedOut = false;
+
+        // Clocking the sample out toggles DOUT, drop the notifications those edges raised
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+}
+
+std::error_code StrainSensor::readout(int32_t& value) {
+    uint32_t cpuCycles = 0;
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+    if (m_spiReadout.initialized()) {
+        if (const auto err = m_spiReadout.read(value)) {
+            return err;
+        }
+        cpuCycles = m_spiReadout.lastInterruptCycles();
+    } else
+#endif
+    {
+        // The driver holds one critical section over the whole readout, all 24 data and 1 to 3 gain pulses
+        const uint32_t start = esp_cpu_get_cycle_count();
+        if (const esp_err_t err = hx711_read_data(&m_hx711_dev, &value)) {
+            return std::make_error_code(err);
+        }
+        cpuCycles = esp_cpu_get_cycle_count() - start;
+    }
+
+    m_reads.store(m_reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_lastCpuCycles.store(cpuCycles, std::memory_order_relaxed);
+    if (cpuCycles > m_maxCpuCycles.load(std::memory_order_relaxed)) {
+        m_maxCpuCycles.store(cpuCycles, std::memory_order_relaxed);
+    }
+    return {};
+}
+
+StrainSensor::ReadoutStats StrainSensor::getReadoutStats() const {
+    ReadoutStats stats{
+            .spi       = false,
+            .reads     = m_reads.load(std::memory_order_relaxed),
+            .lastCpuNs = m_lastCpuCycles.load(std::memory_order_relaxed) * 1000 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+            .maxCpuNs  = m_maxCpuCycles.load(std::memory_order_relaxed) * 1000 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+    };
+#ifdef CONFIG_STRAIN_SENSOR_HX711_SPI
+    stats.spi = m_spiReadout.initialized();
+#endif
+    return stats;
+}
+
 std::expected<StrainSensor::StrainState, std::error_code> StrainSensor::getPressState() {
     auto strainLevel = readStrainLevel();
     if (!strainLevel.has_value()) {
@@ -98,12 +260,18 @@ std::expected<StrainSensor::StrainState, std::error_code> StrainSensor::getPress
 
     StrainState state;
 
-    if (m_filteredRestingLevel - strainLevel.value() > m_config.hardPressOffsetValue.value()) {
-        state.level = StrainLevel::HARD_PRESS;
-    } else if (m_filteredRestingLevel - strainLevel.value() > m_config.lightPressOffsetValue.value()) {
-        state.level = StrainLevel::LIGHT_PRESS;
-    } else {
-        state.level = StrainLevel::RESTING;
+    // Debounced by the press engine, which already saw the sample
+    switch (m_pressEngine.level()) {
+        case PressEngine::Level::HARD:
+            state.level = StrainLevel::HARD_PRESS;
+            break;
+        case PressEngine::Level::LIGHT:
+            state.level = StrainLevel::LIGHT_PRESS;
+            break;
+        case PressEngine::Level::RELEASED:
+        default:
+            state.level = StrainLevel::RESTING;
+            break;
     }
 
     const float configRestingValue = static_cast<float>(m_config.restingValue.value());
@@ -113,38 +281,69 @@ std::expected<StrainSensor::StrainState, std::error_code> StrainSensor::getPress
     return state;
 }
 
-std::expected<signed long, std::error_code> StrainSensor::readStrainLevel() {
+std::expected<StrainSensor::Sample, std::error_code> StrainSensor::getLatestSample() const {
     if (m_status != Status::RUNNING) {
-        ESP_LOGW(TAG, "Strain sensor not running");
         return std::unexpected(std::make_error_code(static_cast<esp_err_t>(ESP_ERR_INVALID_STATE)));
     }
 
-    if (const auto err = hx711_wait(&m_hx711_dev, 100)) {
-        ESP_LOGE(TAG, "Failed wait for strain sensor: %s", esp_err_to_name(err));
-        return std::unexpected(std::make_error_code(err));
+    const auto sample = m_samples.latest();
+    if (!sample.has_value() || esp_timer_get_time() - sample->timestamp > m_sampleTimeoutUs) {
+        return std::unexpected(std::make_error_code(static_cast<esp_err_t>(ESP_ERR_TIMEOUT)));
     }
 
-    signed long data = 0;
-    if (const auto err = hx711_read_data(&m_hx711_dev, &data)) {
-        ESP_LOGE(TAG, "Failed read to strain sensor value: %s", esp_err_to_name(err));
-        return std::unexpected(std::make_error_code(err));
+    return sample.value();
+}
+
+std::expected<signed long, std::error_code> StrainSensor::readStrainLevel() {
+    const auto sample = getLatestSample();
+    if (!sample.has_value()) {
+        return std::unexpected(sample.error());
     }
 
-    return data;
+    return sample->value;
 }
 
 std::expected<signed long, std::error_code> StrainSensor::readAverageStrainLevel(size_t samples) {
-    signed long data;
     if (m_status != Status::RUNNING) {
         return std::unexpected(std::make_error_code(static_cast<esp_err_t>(ESP_ERR_INVALID_STATE)));
     }
+    if (samples == 0) {
+        return std::unexpected(std::make_error_code(static_cast<esp_err_t>(ESP_ERR_INVALID_ARG)));
+    }
 
-    if (const auto err = hx711_read_average(&m_hx711_dev, samples, &data)) {
-        ESP_LOGE(TAG, "Failed to read average strain sensor value: %s", esp_err_to_name(err));
-        return std::unexpected(std::make_error_code(err));
+    // Only samples taken after the call count towards the average
+    uint32_t cursor     = m_samples.count();
+    int64_t  sum        = 0;
+    size_t   count      = 0;
+    int64_t  lastSample = esp_timer_get_time();
+    while (count < samples) {
+        const size_t consumed = m_samples.consume(cursor, [&](const Sample& sample) {
+            if (count < samples) {
+                sum += sample.value;
+                count++;
+            }
+        });
+
+        if (consumed > 0) {
+            lastSample = esp_timer_get_time();
+        } else if (esp_timer_get_time() - lastSample > m_sampleTimeoutUs) {
+            ESP_LOGE(TAG, "Failed to read average strain sensor value: no new samples");
+            return std::unexpected(std::make_error_code(static_cast<esp_err_t>(ESP_ERR_TIMEOUT)));
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
     }
 
-    return data;
+    return static_cast<signed long>(sum / static_cast<int64_t>(samples));
+}
+
+void StrainSensor::updatePressCalibration() {
+    m_pressEngine.setCalibration({
+            .resting = m_config.restingValue.value(),
+            .light   = m_config.lightPressOffsetValue.value(),
+            .hard    = m_config.hardPressOffsetValue.value(),
+            .noise   = m_config.strainNoiseValue.value(),
+    });
 }
 
 std::error_code StrainSensor::saveConfig() {
@@ -161,111 +360,189 @@ std::error_code StrainSensor::resetConfig() {
         ESP_LOGE(TAG, "Unable to reset config: %s - %s", esp_err_to_name(err.value()), err.message().c_str());
         return err;
     }
+    updatePressCalibration();
 
     return {};
 }
 
-std::error_code StrainSensor::calibrateNoiseValue(bool save) {
-    ESP_LOGD(TAG, "calibrating noise value");
-    ESP_LOGI(TAG, "Current noise value: %lu", m_restingStateNoise);
+std::error_code StrainSensor::startCalibration() {
+    if (m_status != Status::RUNNING) {
+        return std::make_error_code(static_cast<esp_err_t>(ESP_ERR_INVALID_STATE));
+    }
 
-    constexpr auto num_measurements = CONFIG_STRAIN_SENSOR_NUM_CALIBRATION_MEASUREMENTS;
+    // Shown right away, run() takes over on its next pass
+    m_calibrationProgress.store({CalibrationState::ACTIVE, CalibrationStep::NOISE, 0, 0}, std::memory_order_release);
+    m_calibrationRequested = true;
+    return {};
+}
 
-    etl::array<signed long, num_measurements> measurements{};
-    for (auto i = 0; i < num_measurements; i++) {
-        auto data = readStrainLevel();
-        if (!data.has_value()) {
-            return data.error();
-        }
-        measurements[i] = data.value();
-        vTaskDelay(pdMS_TO_TICKS(5));
+std::expected<StrainSensor::CalibrationState, std::error_code> StrainSensor::getCalibrationState() const {
+    const auto state = m_calibrationProgress.load(std::memory_order_acquire).state;
+    if (state == CalibrationState::ERROR) {
+        return std::unexpected(std::make_error_code(m_calibrationError.load(std::memory_order_relaxed)));
     }
+    return state;
+}
 
-    auto [min, max]     = std::minmax_element(measurements.begin(), measurements.end());
-    m_restingStateNoise = (*max - *min);
-    m_config.updateField(m_config.strainNoiseValue, m_restingStateNoise);
-
-    ESP_LOGI(TAG, "Strain noise: %lu", m_restingStateNoise);
+void StrainSensor::advanceCalibration() {
+    auto& run = m_calibrationRun;
+    if (m_calibrationRequested.exchange(false)) {
+        ESP_LOGI(TAG, "Starting calibration");
+        m_calibrationError.store(ESP_OK, std::memory_order_relaxed);
+        // Only samples taken after the request count
+        run.cursor = m_samples.count();
+        beginCalibrationStep(CalibrationStep::NOISE);
+    }
 
-    if (save) {
-        return saveConfig();
+    const auto state = m_calibrationProgress.load(std::memory_order_relaxed).state;
+    if (state != CalibrationState::WAITING_FOR_THRESHOLD_PASS && state != CalibrationState::ACTIVE) {
+        return;
     }
 
-    return {};
+    const int64_t now = esp_timer_get_time();
+    if (m_samples.consume(run.cursor, [this](const Sample& sample) { calibrationSample(sample); }) > 0) {
+        run.lastArrival = now;
+    } else if (now - run.lastArrival > m_sampleTimeoutUs) {
+        ESP_LOGE(TAG, "Failed to calibrate strain sensor: no new samples");
+        failCalibration(ESP_ERR_TIMEOUT);
+    }
 }
 
-std::expected<StrainSensor::CalibrationState, std::error_code> StrainSensor::getCalibrationState() {
-    if (m_calibrationError) {
-        return std::unexpected(m_calibrationError);
+void StrainSensor::beginCalibrationStep(const CalibrationStep step, const uint8_t retries) {
+    auto& run           = m_calibrationRun;
+    run.step            = step;
+    run.retries         = retries;
+    run.stats           = RunningStats{};
+    run.windowDeviation = 0.0f;
+    run.lastArrival     = esp_timer_get_time();
+
+    if (step > CalibrationStep::RESTING_VALUE) {
+        const auto level = static_cast<StrainLevel>(step);
+        ESP_LOGI(TAG, "Waiting for input to go above %s (%ld)", LevelToString[level - 1].c_str(), calibrationThreshold(level));
+        publishCalibration(CalibrationState::WAITING_FOR_THRESHOLD_PASS, 0);
+    } else {
+        ESP_LOGI(TAG, "Calibrating %s value, don't touch until next log message", step == CalibrationStep::NOISE ? "noise" : "resting");
+        run.stepStart = run.lastArrival;
+        publishCalibration(CalibrationState::ACTIVE, 0);
     }
-    return m_calibrationStatus;
 }
 
-void StrainSensor::calibrateValue(const StrainSensor::StrainLevel strainLevel, const bool save) {
-    m_calibrationStatus = CalibrationState::WAITING_FOR_THRESHOLD_PASS;
-    m_calibrationError  = {};
-
-    signed long threshold;
-    if (strainLevel > StrainLevel::RESTING) {
-        threshold = m_config.getStrainValue(static_cast<StrainLevel>(strainLevel - 1));
-    } else {
-        threshold = INT32_MIN;
-    }
-
-    // We might need to retry this multiple times if the average press value isn't low enough
-    bool calibrationComplete = false;
-    while (!calibrationComplete) {
-        // Wait for press to go above threshold
-        if (strainLevel > StrainLevel::RESTING) {
-            ESP_LOGI(TAG, "Waiting for input to go above %s (%ld)", LevelToString[strainLevel - 1].c_str(), threshold);
-
-            signed long level = INT32_MIN;
-            // Scale required pressure difference between the levels based on the level
-            // so from resting to light press requires less effort than from light to hard press
-            while (level <= threshold + (m_restingStateNoise * strainLevel)) {
-                auto data = readStrainLevel();
-                if (!data.has_value()) {
-                    ESP_LOGE(TAG, "Failed waiting for input, trying again");
-                    m_calibrationError  = data.error();
-                    m_calibrationStatus = CalibrationState::ERROR;
-                    break;
-                }
-                level = data.value();
-                vTaskDelay(pdMS_TO_TICKS(1));
-            }
-            ESP_LOGI(TAG, "Sufficient strain input detected [%ld], don't let go until next log message", level);
-        } else {
-            ESP_LOGI(TAG, "Calibrating resting value, don't touch until next log message");
+void StrainSensor::calibrationSample(const Sample& sample) {
+    auto&      run   = m_calibrationRun;
+    const auto state = m_calibrationProgress.load(std::memory_order_relaxed).state;
+
+    if (state == CalibrationState::WAITING_FOR_THRESHOLD_PASS) {
+        // Scale required pressure difference between the levels based on the level
+        // so from resting to light press requires less effort than from light to hard press
+        const int32_t threshold = calibrationThreshold(static_cast<StrainLevel>(run.step));
+        if (sample.value <= threshold) {
+            const int32_t resting  = m_config.restingValue.value();
+            const float   fraction = static_cast<float>(sample.value - resting) / static_cast<float>(threshold - resting);
+            publishCalibration(state, static_cast<uint8_t>(std::clamp(fraction, 0.0f, 1.0f) * 100.0f));
+            return;
         }
-        m_calibrationStatus = CalibrationState::ACTIVE;
 
-        // Start calibration
-        auto data = readAverageStrainLevel(CONFIG_STRAIN_SENSOR_NUM_CALIBRATION_MEASUREMENTS);
-        if (!data.has_value()) {
-            m_calibrationError  = data.error();
-            m_calibrationStatus = CalibrationState::ERROR;
+        ESP_LOGI(TAG, "Sufficient strain input detected [%ld], don't let go until next log message", sample.value);
+        run.stepStart = esp_timer_get_time();
+        publishCalibration(CalibrationState::ACTIVE, 0);
+        return;
+    }
+    if (state != CalibrationState::ACTIVE) {
+        return;
+    }
+
+    if (run.stats.count() == 0) {
+        run.firstSampleUs = sample.timestamp;
+    }
+    run.lastSampleUs = sample.timestamp;
+    run.stats.add(sample.value);
+
+    // Noise has settled once its running deviation stops moving, levels are known to within a fraction
+    // of the noise. The samples needed for that only drive the percentage, the estimate moves with the data.
+    constexpr size_t maxSamples = CONFIG_STRAIN_SENSOR_NUM_CALIBRATION_MEASUREMENTS;
+    const size_t     count      = run.stats.count();
+    bool             converged  = false;
+    float            needed     = 0.0f;
+    if (run.step == CalibrationStep::NOISE) {
+        // Compared window by window, a deviation that keeps growing (a drifting signal, a hand on the
+        // knob) keeps sampling up to the cap
+        if (count % m_noiseWindow != 0) {
+            if (count >= maxSamples) {
+                finishCalibrationStep();
+            }
             return;
         }
+        // Deviations below a count are quantisation, not noise
+        const float deviation = run.stats.standardDeviation();
+        const float change    = std::fabs(deviation - run.windowDeviation) / std::max(deviation, 1.0f);
+        run.windowDeviation   = deviation;
+        converged             = count >= 2 * m_noiseWindow && change <= m_noiseTolerance;
+        // The deviation of a steady signal moves by about a window's worth of 1 / count
+        needed = static_cast<float>(count) * change / m_noiseTolerance;
+    } else {
+        const float tolerance = m_levelTolerance * static_cast<float>(m_restingStateNoise);
+        const float width     = m_confidenceZ * run.stats.standardDeviation() / tolerance;
+        converged             = run.stats.meanHalfWidth(m_confidenceZ) <= tolerance;
+        needed                = width * width;
+    }
 
-        ESP_LOGI(TAG, "Measured %s value: %ld", LevelToString[strainLevel].c_str(), data.value());
+    if (count >= maxSamples || (count >= m_minCalibrationSamples && converged)) {
+        finishCalibrationStep();
+        return;
+    }
 
-        // Higher strain levels need higher separation to avoid accidental hard presses
-        if (data.value() <= threshold + (m_restingStateNoise * strainLevel)) {
-            ESP_LOGI(TAG, "Please try again while pressing a *little* bit harder");
-        } else {
-            m_config.updateField(strainLevel, data.value_or(INT32_MAX) );
-
-            if (save) {
-                if (const auto err = saveConfig()) {
-                    m_calibrationError  = err;
-                    m_calibrationStatus = CalibrationState::ERROR;
-                }
-                return;
-            }
+    needed = std::clamp(needed, static_cast<float>(m_minCalibrationSamples), static_cast<float>(maxSamples));
+    publishCalibration(state, static_cast<uint8_t>(std::min(99.0f, static_cast<float>(count) * 100.0f / needed)));
+}
 
-            m_calibrationError  = {};
-            m_calibrationStatus = CalibrationState::FINISHED;
-            calibrationComplete = true;
-        }
+void StrainSensor::finishCalibrationStep() {
+    auto&       run  = m_calibrationRun;
+    const char* what = run.step == CalibrationStep::NOISE ? "noise" : LevelToString[run.step].c_str();
+
+    // A fixed number of samples, as calibration used to take, at the sample rate just measured
+    const int64_t samplePeriodUs = (run.lastSampleUs - run.firstSampleUs) / static_cast<int64_t>(run.stats.count() - 1);
+    ESP_LOGI(TAG, "Calibrated %s value from %u samples in %lld ms, %d samples would have taken %lld ms", what,
+             run.stats.count(), (esp_timer_get_time() - run.stepStart) / 1000, CONFIG_STRAIN_SENSOR_NUM_CALIBRATION_MEASUREMENTS,
+             samplePeriodUs * CONFIG_STRAIN_SENSOR_NUM_CALIBRATION_MEASUREMENTS / 1000);
+
+    if (run.step == CalibrationStep::NOISE) {
+        m_restingStateNoise = std::max(1L, std::lround(run.stats.standardDeviation()));
+        m_config.updateField(m_config.strainNoiseValue, m_restingStateNoise);
+        updatePressCalibration();
+        ESP_LOGI(TAG, "Strain noise: %ld (standard deviation)", m_restingStateNoise);
+
+        beginCalibrationStep(CalibrationStep::RESTING_VALUE);
+        return;
     }
+
+    const auto level = static_cast<StrainLevel>(run.step);
+    const auto value = static_cast<signed long>(std::lround(run.stats.mean()));
+    ESP_LOGI(TAG, "Measured %s value: %ld", what, value);
+
+    // Higher strain levels need higher separation to avoid accidental hard presses
+    if (level > StrainLevel::RESTING && value <= calibrationThreshold(level)) {
+        ESP_LOGI(TAG, "Please try again while pressing a *little* bit harder");
+        beginCalibrationStep(run.step, run.retries + 1);
+        return;
+    }
+
+    m_config.updateField(level, value);
+    updatePressCalibration();
+
+    if (run.step != CalibrationStep::HARD_PRESS_VALUE) {
+        beginCalibrationStep(static_cast<CalibrationStep>(run.step + 1));
+        return;
+    }
+
+    if (const auto err = saveConfig()) {
+        failCalibration(err.value());
+        return;
+    }
+    ESP_LOGI(TAG, "Calibration finished");
+    publishCalibration(CalibrationState::FINISHED, 100);
+}
+
+void StrainSensor::failCalibration(const esp_err_t err) {
+    m_calibrationError.store(err, std::memory_order_relaxed);
+    publishCalibration(CalibrationState::ERROR, 0);
 }
@@ -2,7 +2,11 @@
 #include <lvgl.h>
 #include <stdio.h>
 
+#include <optional>
+
+#include "Angle.hpp"
 #include "DisplayDriver.hpp"
+#include "FastMath.hpp"
 #include "LightSensor.hpp"
 #include "MagneticEncoder.hpp"
 #include "Manager.hpp"
@@ -27,11 +31,17 @@ void lvgl_task(void*) {
     }
 }
 
-void calibrateStrainSensor(StrainSensor& strainSensor) {
-    auto column_ = lv_obj_create(lv_scr_act());
-    lv_obj_set_size(column_, 240, 240);
-    lv_obj_set_flex_flow(column_, LV_FLEX_FLOW_COLUMN);
-
+// First-time strain calibration runs inside the strain sensor, the screen only follows its progress
+struct StrainCalibrationScreen {
+    lv_obj_t*                         title = nullptr;
+    lv_obj_t*                         bar   = nullptr;
+    StrainSensor::CalibrationProgress shown{};
+};
+
+/**
+ * @brief Creates the calibration screen, the caller holds the LVGL mutex
+ */
+StrainCalibrationScreen createStrainCalibrationScreen() {
     static lv_style_t style_indic;
     lv_style_init(&style_indic);
     lv_style_set_bg_opa(&style_indic, LV_OPA_COVER);
@@ -39,49 +49,108 @@ void calibrateStrainSensor(StrainSensor& strainSensor) {
     lv_style_set_bg_grad_color(&style_indic, lv_palette_main(LV_PALETTE_RED));
     lv_style_set_bg_grad_dir(&style_indic, LV_GRAD_DIR_HOR);
 
-    lv_obj_t * label1 = lv_label_create(lv_scr_act());
-    lv_obj_set_style_text_color(label1, lv_color_black(), LV_PART_MAIN);
-    lv_label_set_long_mode(label1, LV_LABEL_LONG_WRAP);     /*Break the long lines*/
+    StrainCalibrationScreen screen;
+    screen.title = lv_label_create(lv_scr_act());
+    lv_obj_set_style_text_color(screen.title, lv_color_black(), LV_PART_MAIN);
+    lv_label_set_long_mode(screen.title, LV_LABEL_LONG_WRAP);     /*Break the long lines*/
+
+    lv_obj_set_width(screen.title, 200);  /*Set smaller width to make the lines wrap*/
+    lv_obj_set_style_text_align(screen.title, LV_TEXT_ALIGN_CENTER, 0);
+    lv_obj_align(screen.title, LV_ALIGN_CENTER, 0, -40);
+    lv_label_set_text_static(screen.title, "");
+
+    screen.bar = lv_bar_create(lv_scr_act());
+    lv_obj_add_style(screen.bar, &style_indic, LV_PART_INDICATOR);
+    lv_obj_set_size(screen.bar, 150, 20);
+    lv_obj_align(screen.bar, LV_ALIGN_CENTER, 0, 40);
+    return screen;
+}
 
-    lv_obj_set_width(label1, 200);  /*Set smaller width to make the lines wrap*/
-    lv_obj_set_style_text_align(label1, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_align(label1, LV_ALIGN_CENTER, 0, -40);
+/**
+ * @brief Shows the current calibration step, the caller holds the LVGL mutex
+ * @return False once calibration ended and the screen was removed
+ */
+bool updateStrainCalibrationScreen(const StrainSensor& strainSensor, StrainCalibrationScreen& screen) {
+    static constexpr const char* waitingText[] = {"", "", "Press the knob lightly", "Press the knob hard"};
+    static constexpr const char* retryText[]   = {"", "", "Press a little harder", "Press a little harder"};
+    static constexpr const char* activeText[]  = {"Calibrating noise value, don't touch", "Calibrating resting value, don't touch",
+                                                  "Calibrating light press value, hold it", "Calibrating hard press value, hold it"};
+
+    const auto progress = strainSensor.getCalibrationProgress();
+    if (progress.state == StrainSensor::FINISHED || progress.state == StrainSensor::ERROR) {
+        if (const auto state = strainSensor.getCalibrationState(); !state.has_value()) {
+            ESP_LOGE("main", "Unable to calibrate strain sensor: %s", state.error().message().c_str());
+        }
+        lv_obj_delete(screen.title);
+        lv_obj_delete(screen.bar);
+        return false;
+    }
 
-    lv_label_set_text(label1, "Sample text");
-    lv_task_handler();
+    if (progress.state != screen.shown.state || progress.step != screen.shown.step || progress.retries != screen.shown.retries) {
+        const auto& text = progress.state == StrainSensor::ACTIVE ? activeText : progress.retries > 0 ? retryText : waitingText;
+        lv_label_set_text_static(screen.title, text[progress.step]);
+    }
+    if (progress.percentage != screen.shown.percentage) {
+        lv_bar_set_value(screen.bar, progress.percentage, LV_ANIM_OFF);
+    }
+    screen.shown = progress;
+    return true;
+}
 
-    lv_obj_t * label2 = lv_label_create(lv_scr_act());
-    lv_label_set_long_mode(label2, LV_LABEL_LONG_WRAP); /* Break the long lines */
-    lv_obj_set_width(label2, 150);
-    lv_label_set_text(label2, "");
-    lv_obj_align(label2, LV_ALIGN_CENTER, 0, 40);
+// Motor calibrations sweep the shaft for seconds, their screen waits for the user to start them
+struct MotorCalibrationScreen {
+    lv_obj_t* title = nullptr;
+    bool      armed = false; ///< Long pressed, starts once the knob is let go
+};
+
+/**
+ * @brief Whether a calibration that sweeps the shaft is missing
+ */
+bool needsMotorCalibration(MagneticEncoder& magneticEncoder, MotorDriver& motorDriver) {
+    return magneticEncoder.needsLinearityCalibration() || motorDriver.needsCoggingCalibration();
+}
 
-    if (strainSensor.needsFirstTimeSetup()) {
-        lv_label_set_text(label1, "Calibrating noise value");
-        strainSensor.calibrateNoiseValue();
-        lv_label_set_text(label1, "Done calibrating noise value");
-
-        vTaskDelay(pdMS_TO_TICKS(300));
-        lv_label_set_text(label1, "Calibrating resting value");
-        strainSensor.calibrateValue(StrainSensor::RESTING);
-        lv_label_set_text(label1, "Done calibrating!");
-
-        vTaskDelay(pdMS_TO_TICKS(300));
-        lv_label_set_text(label1, "Calibrating light press value");
-        strainSensor.calibrateValue(StrainSensor::LIGHT_PRESS);
-        lv_label_set_text(label1, "Done calibrating!");
-
-        vTaskDelay(pdMS_TO_TICKS(300));
-        lv_label_set_text(label1, "Calibrating hard press value");
-        strainSensor.calibrateValue(StrainSensor::HARD_PRESS);
-        lv_label_set_text(label1, "Done calibrating!");
-
-        strainSensor.saveConfig();
-        vTaskDelay(pdMS_TO_TICKS(300));
+/**
+ * @brief Creates the motor calibration screen, the caller holds the LVGL mutex
+ */
+MotorCalibrationScreen createMotorCalibrationScreen() {
+    MotorCalibrationScreen screen;
+    screen.title = lv_label_create(lv_scr_act());
+    lv_obj_set_style_text_color(screen.title, lv_color_black(), LV_PART_MAIN);
+    lv_label_set_long_mode(screen.title, LV_LABEL_LONG_WRAP);
+    lv_obj_set_width(screen.title, 200);
+    lv_obj_set_style_text_align(screen.title, LV_TEXT_ALIGN_CENTER, 0);
+    lv_obj_align(screen.title, LV_ALIGN_CENTER, 0, -40);
+    lv_label_set_text_static(screen.title, "Motor calibration needed, long press the knob and let go to start");
+    return screen;
+}
+
+/**
+ * @brief Runs the missing motor calibrations and removes the screen, blocks while the shaft sweeps
+ */
+void runMotorCalibration(MagneticEncoder& magneticEncoder, MotorDriver& motorDriver, MotorCalibrationScreen& screen) {
+    const auto show = [&screen](const char* text) {
+        std::scoped_lock lock{mutex};
+        lv_label_set_text_static(screen.title, text);
+    };
+
+    if (magneticEncoder.needsLinearityCalibration()) {
+        show("Calibrating encoder, don't touch the knob");
+        if (const auto err = motorDriver.calibrateEncoderLinearity()) {
+            ESP_LOGE("main", "Unable to calibrate encoder linearity: %s", err.message().c_str());
+        }
+    }
+
+    // After linearity, so the cogging map is recorded against corrected angles
+    if (motorDriver.needsCoggingCalibration()) {
+        show("Calibrating cogging, don't touch the knob");
+        if (const auto err = motorDriver.calibrateCogging()) {
+            ESP_LOGE("main", "Unable to calibrate cogging: %s", err.message().c_str());
+        }
     }
 
-    lv_obj_delete_async(label1);
-    lv_obj_delete_async(label2);
+    std::scoped_lock lock{mutex};
+    lv_obj_delete(screen.title);
 }
 
 [[noreturn]] void startSmartknob(void) {
@@ -112,11 +181,12 @@ void calibrateStrainSensor(StrainSensor& strainSensor) {
     // Wait for components to actually be running
     while (!sdk::Manager::isInitialized()) { vTaskDelay(1); };
 
-    auto res = magneticEncoder.getDevice();
-    if (res.has_value()) {
-        motorDriver.setSensor(res.value());
-    } else {
-        ESP_LOGE("main", "Unable to start magnetic encoder: %s", res.error().message().c_str());
+    if (const auto err = motorDriver.setSensor(magneticEncoder)) {
+        // The motor can't run without its sensor, park here so the other components stay alive
+        ESP_LOGE("main", "Unable to start magnetic encoder, stopping bring-up: %s", err.message().c_str());
+        for (;;) {
+            vTaskDelay(portMAX_DELAY);
+        }
     }
 
     lv_obj_t* dot = lv_led_create(lv_scr_act());
@@ -130,7 +200,7 @@ void calibrateStrainSensor(StrainSensor& strainSensor) {
     msg.primaryColor   = {.hue = HUE_PINK, .saturation = 255, .value = 200};
     msg.secondaryColor = {.hue = HUE_YELLOW, .saturation = 255, .value = 200};
     msg.effect         = ringLights::POINTER;
-    msg.paramA         = 1.0f;
+    msg.paramA         = fastMath::Angle::fromDegrees(1.0f);
     msg.paramB         = 40;
     ringLights.enqueue(msg);
 
@@ -145,38 +215,127 @@ void calibrateStrainSensor(StrainSensor& strainSensor) {
 
     xTaskCreatePinnedToCore(lvgl_task, "LVGL", 4096, NULL, 24, NULL, 0);
 
-    calibrateStrainSensor(strainSensor);
+    std::optional<StrainCalibrationScreen> calibrationScreen;
+    if (strainSensor.needsFirstTimeSetup()) {
+        if (const auto err = strainSensor.startCalibration()) {
+            ESP_LOGE("main", "Unable to start strain calibration: %s", err.message().c_str());
+        } else {
+            std::scoped_lock lock{mutex};
+            calibrationScreen = createStrainCalibrationScreen();
+        }
+    }
+    // Started with a long press, so only offered once the strain sensor is calibrated
+    std::optional<MotorCalibrationScreen> motorCalibrationScreen;
+    if (!calibrationScreen.has_value() && needsMotorCalibration(magneticEncoder, motorDriver)) {
+        std::scoped_lock lock{mutex};
+        motorCalibrationScreen = createMotorCalibrationScreen();
+    }
 
     size_t count = 0;
     for (;;) {
         vTaskDelay(pdMS_TO_TICKS(10));
-        auto degrees = magneticEncoder.getDegrees();
-        auto radians = magneticEncoder.getRadians();
-        auto dev     = magneticEncoder.getDevice();
+        // One snapshot per iteration, so every consumer below sees the same sample
+        const auto encoder = magneticEncoder.snapshot();
+        // The ring and the screen count clockwise, the encoder counter-clockwise
+        const auto angle = -encoder.angle();
+
+        // Click when a press gets harder, so pressing the knob feels like pressing a button
+        PressEngine::Event event;
+        bool               startMotorCalibration = false;
+        while (strainSensor.receivePressEvent(event)) {
+            // Presses keep the motor awake as well as turning the knob does
+            motorDriver.notifyActivity();
+            switch (event.type) {
+                case PressEngine::EventType::PRESS:
+                    motorDriver.playWaveform(hapticWaveform::Effect::CLICK);
+                    break;
+                case PressEngine::EventType::HARD_PRESS:
+                    motorDriver.playWaveform(hapticWaveform::Effect::DOUBLE_TICK);
+                    break;
+                case PressEngine::EventType::LONG_PRESS:
+                    ESP_LOGI("main", "long press");
+                    if (motorCalibrationScreen.has_value()) {
+                        motorCalibrationScreen->armed = true;
+                    }
+                    break;
+                case PressEngine::EventType::DOUBLE_PRESS:
+                    ESP_LOGI("main", "double press");
+                    break;
+                case PressEngine::EventType::RELEASE:
+                    // The sweep must not start while the knob is still held
+                    startMotorCalibration = motorCalibrationScreen.has_value() && motorCalibrationScreen->armed;
+                    break;
+            }
+        }
+        // A held press keeps the motor awake as well, every iteration so short idle timeouts never lapse while held
+        if (strainSensor.getPressLevel() != PressEngine::Level::RELEASED) {
+            motorDriver.notifyActivity();
+        }
+        if (startMotorCalibration) {
+            runMotorCalibration(magneticEncoder, motorDriver, *motorCalibrationScreen);
+            motorCalibrationScreen.reset();
+        }
 
         if (++count > 100) {
             if (auto light = lightSensor.readLightLevel(); light.has_value()) {
                 ESP_LOGI("main", "light value: %ld", light.value());
             }
 
-            ESP_LOGI("main", "encoder degrees: %lf", degrees.value());
-            ESP_LOGI("main", "raw encoder degrees: %lf", magneticEncoder.getDevice()->get()->get_degrees());
+            ESP_LOGI("main", "encoder degrees: %f", angle.degrees());
+            ESP_LOGI("main", "encoder velocity: %f rad/s (sample %lu)", encoder.velocity, encoder.sequence);
+#ifdef CONFIG_MAGNETIC_ENCODER_HYBRID
+            const auto incremental = magneticEncoder.getIncrementalStats();
+            ESP_LOGI("main", "ABZ resyncs %lu (%lu skipped), drift last/max: %lu/%lu counts", incremental.resyncs,
+                     incremental.skippedResyncs, incremental.lastError, incremental.maxError);
+#endif
 
             ESP_LOGI("main", "current haptics position: %f", motorDriver.getPosition());
 
+            const auto loopStats = motorDriver.getLoopStats();
+            ESP_LOGI("main", "FOC loop period min/mean/max: %lu/%.1f/%lu us", loopStats.minPeriodUs, loopStats.meanPeriodUs, loopStats.maxPeriodUs);
+#ifdef CONFIG_MOTOR_DRIVER_PWM_SYNC
+            const auto pwmSync = motorDriver.getPwmSyncStats();
+            ESP_LOGI("main", "PWM sync: %lu ticks synced, PWM period %lu ns, sample to PWM latency last/min/max: %lu/%lu/%lu ns",
+                     pwmSync.syncs, pwmSync.pwmPeriodNs, pwmSync.lastLatencyNs, pwmSync.minLatencyNs, pwmSync.maxLatencyNs);
+            ESP_LOGI("main", "PWM sync capture: %lu interrupts, mean/max %lu/%lu ns, %lu.%lu%% CPU", pwmSync.interrupts,
+                     pwmSync.meanInterruptNs, pwmSync.maxInterruptNs, pwmSync.loadPermille / 10, pwmSync.loadPermille % 10);
+#endif
+#ifdef CONFIG_MOTOR_DRIVER_LOOP_PROFILER
+            for (const auto& probe : motorDriver.getLoopProfile().probes) {
+                ESP_LOGI("main", "FOC %-12s p50/p99/max: %lu/%lu/%lu cycles, %lu over budget", probe.name, probe.p50, probe.p99, probe.max, probe.overruns);
+            }
+#endif
+
             ESP_LOGI("main", "strain level: %ld", strainSensor.readStrainLevel().value_or(INT32_MAX));
+            const auto pressLatency = strainSensor.getPressLatencyStats();
+            ESP_LOGI("main", "press events %lu (%lu dropped), sample to queue latency last/max: %lu/%lu us", pressLatency.events,
+                     pressLatency.dropped, pressLatency.lastUs, pressLatency.maxUs);
+            const auto readout = strainSensor.getReadoutStats();
+            ESP_LOGI("main", "strain readout %s: %lu samples, CPU time %s last/max: %lu/%lu ns", readout.spi ? "SPI" : "bit-banged",
+                     readout.reads, readout.spi ? "in interrupts" : "with interrupts masked", readout.lastCpuNs, readout.maxCpuNs);
+
+            const auto idle = motorDriver.getIdleStats();
+            ESP_LOGI("main", "motor %s, idle %lu times for %lu ms, wake latency last/max: %lu/%lu us", idle.idle ? "idle" : "active",
+                     idle.entries, idle.idleTimeMs, idle.lastWakeLatencyUs, idle.maxWakeLatencyUs);
 
             count = 0;
         }
 
-        msg.paramA = degrees.value();
+        msg.paramA = angle;
 
         ringLights.enqueue(msg);
 
-        auto x = static_cast<int>(100 * std::cos((magneticEncoder.getRadians().value() * -1) - M_PI_2));
-        auto y = static_cast<int>(100 * std::sin((magneticEncoder.getRadians().value() * -1) - M_PI_2));
+        const auto direction = (angle - fastMath::quarterTurn).sincos();
+        auto       x         = static_cast<int>(100 * direction.cos);
+        auto       y         = static_cast<int>(100 * direction.sin);
         std::scoped_lock lock{mutex};
         lv_obj_align(dot, LV_ALIGN_CENTER, x, y);
+        if (calibrationScreen.has_value() && !updateStrainCalibrationScreen(strainSensor, *calibrationScreen)) {
+            calibrationScreen.reset();
+            if (needsMotorCalibration(magneticEncoder, motorDriver)) {
+                motorCalibrationScreen = createMotorCalibrationScreen();
+            }
+        }
     }
 }
 
@@ -208,5 +367,9 @@ extern "C" void app_main(void) {
 
     printf("Minimum free heap size: %" PRIu32 " bytes\n", esp_get_minimum_free_heap_size());
 
+#ifdef CONFIG_FASTMATH_BENCHMARK
+    fastMath::benchmark();
+#endif
+
     startSmartknob();
 }
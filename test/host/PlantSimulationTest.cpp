@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "FastMath.hpp"
+#include "HapticProfile.hpp"
+#include "PlantSimulator.hpp"
+#include "VelocityObserver.hpp"
+#include "sdkconfig.h"
+
+/**
+ * @brief Runs the haptic control path (velocity observer and profile command, as the FOC task does per
+ *        tick) against the simulated plant and checks how the knob behaves once the user lets go
+ *
+ * Usage: plant_simulation_test <detent_capture|wall_stiffness|no_limit_cycle>, exits 0 when the check passes.
+ */
+
+namespace {
+    constexpr float    supplyVoltage = 5.0f; // power_supply_voltage of the motor driver
+    constexpr uint32_t frequency     = CONFIG_MOTOR_DRIVER_FOC_LOOP_FREQUENCY;
+    constexpr float    bandwidthHz   = CONFIG_MAGNETIC_ENCODER_VELOCITY_BANDWIDTH;
+    constexpr float    dt            = 1.0f / frequency;
+    constexpr int64_t  periodUs      = 1000000 / frequency;
+
+    // The knob is let go this far, as a fraction of the distance to the next position, from a detent center
+    constexpr float releaseFraction = 0.4f;
+    // Settled once the shaft stays slower than this (rad/s). Not an angle band: detents have a dead zone
+    // around their center, anywhere in which the shaft may come to rest
+    constexpr float settleSpeed = 0.02f;
+    // Let go knobs have to settle within this
+    constexpr uint32_t settleTicks = frequency / 2;
+    // Swinging through the detent by more than this, relative to the release distance, feels underdamped
+    constexpr float maxOvershoot = 10.0f;
+
+    struct Scenario {
+        const char*                       name;
+        const espp::detail::DetentConfig& config;
+        int                               position; // Detent the knob is let go next to
+    };
+
+    const Scenario scenarios[] = {
+            {"ON_OFF_STRONG_DETENTS", espp::detail::ON_OFF_STRONG_DETENTS, 0},
+            {"COARSE_VALUES_STRONG_DETENTS", espp::detail::COARSE_VALUES_STRONG_DETENTS, 16},
+            {"FINE_VALUES_WITH_DETENTS", espp::detail::FINE_VALUES_WITH_DETENTS, 128},
+            {"MAGNETIC_DETENTS", espp::detail::MAGNETIC_DETENTS, 10},
+            {"RETURN_TO_CENTER_WITH_DETENTS", espp::detail::RETURN_TO_CENTER_WITH_DETENTS, 0},
+    };
+
+    struct Run {
+        uint32_t lastUnsettled = 0;    ///< Tick after the last one faster than settleSpeed
+        float    minOffset     = 0.0f; ///< Furthest the knob swung, as a profile offset
+        float    maxOffset     = 0.0f;
+        float    tailSwing     = 0.0f; ///< Peak to peak offset over the last window
+        float    tailSpeed     = 0.0f; ///< Fastest speed over the last window
+        float    finalOffset   = 0.0f;
+        int64_t  controlNs     = 0; ///< Host time in the observer and profile command, over all ticks
+        int64_t  maxControlNs  = 0; ///< Slowest single tick of it
+        uint32_t ticks         = 0;
+
+        float meanControlNs() const { return ticks > 0 ? static_cast<float>(controlNs) / static_cast<float>(ticks) : 0.0f; }
+    };
+
+    /**
+     * @brief Lets go of the knob at a profile offset and runs the control loop for a number of ticks
+     * @param window Ticks at the end of the run tailSwing and tailSpeed are measured over
+     */
+    Run simulate(const HapticProfile& profile, const float releaseOffset, const uint32_t ticks, const uint32_t window = 0) {
+        PlantSimulator   plant(PlantSimulator::Config{});
+        VelocityObserver observer(bandwidthHz);
+
+        // Profile origin at shaft angle 0, so offsets are simply minus the shaft angle
+        plant.reset(-releaseOffset);
+
+        // Starts far from 0 so the observer's first sample restarts it, as after boot
+        int64_t timestampUs = 1000000;
+        Run     run{.minOffset = releaseOffset, .maxOffset = releaseOffset, .ticks = ticks};
+        float   tailMin = INFINITY;
+        float   tailMax = -INFINITY;
+        for (uint32_t tick = 0; tick < ticks; tick++) {
+            const float measured = plant.encoderAngle();
+            timestampUs += periodUs;
+
+            // The work the FOC task does per tick for haptics, timed on the host so regressions show up
+            const auto  start     = std::chrono::steady_clock::now();
+            const float velocity  = observer.update(fastMath::wrapTwoPi(measured), timestampUs);
+            const float command   = profile.command(-measured, velocity, supplyVoltage);
+            const auto  controlNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            run.controlNs += controlNs;
+            run.maxControlNs = std::max<int64_t>(run.maxControlNs, controlNs);
+            plant.step(command, dt);
+
+            const float offset = -plant.angle();
+            run.minOffset      = std::min(run.minOffset, offset);
+            run.maxOffset      = std::max(run.maxOffset, offset);
+            if (fastMath::abs(plant.velocity()) > settleSpeed) {
+                run.lastUnsettled = tick + 1;
+            }
+            if (tick + window >= ticks) {
+                tailMin       = std::min(tailMin, offset);
+                tailMax       = std::max(tailMax, offset);
+                run.tailSpeed = std::max(run.tailSpeed, fastMath::abs(plant.velocity()));
+            }
+        }
+        run.tailSwing   = window > 0 ? tailMax - tailMin : 0.0f;
+        run.finalOffset = -plant.angle();
+        return run;
+    }
+
+    /**
+     * @brief Let go next to a detent, the knob has to snap into it without swinging far through and come
+     *        to rest there
+     */
+    bool detentCapture() {
+        bool passed = true;
+        for (const auto& [name, config, position] : scenarios) {
+            const auto  profile = HapticProfile::fromDetentConfig(config);
+            const float target  = profile->offsetOf(position);
+            const float release = target + releaseFraction * (profile->offsetOf(position + 1) - target);
+            const Run   run     = simulate(*profile, release, frequency);
+
+            const int   captured  = profile->positionAt(run.finalOffset);
+            const float overshoot = std::max(0.0f, target - run.minOffset) / (release - target) * 100.0f;
+            const bool  ok        = captured == position && run.lastUnsettled < settleTicks && overshoot <= maxOvershoot;
+            std::printf("%-30s settled after %6.1f ms at position %4d (expected %4d), overshoot %5.1f%%, final error %5.2f deg, "
+                        "control mean/max %5.0f/%7lld ns  %s\n",
+                        name, static_cast<float>(run.lastUnsettled) * dt * 1000.0f, captured, position, overshoot,
+                        (run.finalOffset - target) * fastMath::radiansToDegrees, run.meanControlNs(),
+                        static_cast<long long>(run.maxControlNs), ok ? "ok" : "FAILED");
+            passed &= ok;
+        }
+        return passed;
+    }
+
+    /**
+     * @brief Past either end stop the command rises linearly with the configured stiffness and pushes
+     *        back, a knob let go beyond the end returns to the last position
+     */
+    bool wallStiffness() {
+        constexpr float depths[]    = {0.02f, 0.05f, 0.1f, 0.2f};
+        constexpr float tolerance   = 0.01f; // Relative
+        constexpr float pastEnd     = 10.0f * fastMath::degreesToRadians;
+        bool            passed      = true;
+        for (const auto& [name, config, position] : scenarios) {
+            const auto profile = HapticProfile::fromDetentConfig(config);
+            if (profile->isPeriodic() || config.end_strength <= 0.0f) {
+                continue;
+            }
+            const float stiffness = HapticProfile::kpFactor * config.end_strength;
+            const float ends[]    = {profile->offsetOf(profile->minPosition()), profile->offsetOf(profile->maxPosition())};
+
+            bool ok = true;
+            for (const float end : ends) {
+                // Pushing further out means a larger offset past the max end, a smaller one past the min end
+                const float outwards = end == ends[1] ? 1.0f : -1.0f;
+                float       previous = 0.0f;
+                for (const float depth : depths) {
+                    // Without a limit, so the slope is not cut off by the supply
+                    const float command = profile->command(end + outwards * depth, 0.0f, INFINITY);
+                    const float slope   = command * outwards / depth;
+                    // Offsets are clockwise and commands counter-clockwise, restoring means the same sign
+                    ok &= command * outwards > previous * outwards;
+                    ok &= fastMath::abs(slope - stiffness) <= tolerance * stiffness;
+                    previous = command;
+                }
+
+                const Run run = simulate(*profile, end + outwards * pastEnd, frequency);
+                ok &= profile->positionAt(run.finalOffset) == profile->positionAt(end) && run.lastUnsettled < settleTicks;
+            }
+
+            std::printf("%-30s end stops %.2f V/rad, released %.0f deg past either end  %s\n", name, stiffness,
+                        pastEnd * fastMath::radiansToDegrees, ok ? "ok" : "FAILED");
+            passed &= ok;
+        }
+        return passed;
+    }
+
+    /**
+     * @brief Once settled, encoder noise and quantisation must not excite a sustained oscillation
+     */
+    bool noLimitCycle() {
+        constexpr uint32_t window   = frequency / 2;
+        // A few encoder counts, the noise alone moves the measurement by one
+        constexpr float maxSwing = 4.0f * fastMath::tau / 16384.0f;
+        bool            passed   = true;
+        for (const auto& [name, config, position] : scenarios) {
+            const auto  profile = HapticProfile::fromDetentConfig(config);
+            const float target  = profile->offsetOf(position);
+            const float release = target + releaseFraction * (profile->offsetOf(position + 1) - target);
+            const Run   run     = simulate(*profile, release, 2 * frequency, window);
+
+            const bool ok = run.tailSwing <= maxSwing && run.tailSpeed <= settleSpeed;
+            std::printf("%-30s last %lu ms: swing %6.4f deg, speed %6.4f rad/s, control mean/max %5.0f/%7lld ns  %s\n", name,
+                        static_cast<unsigned long>(window * 1000 / frequency), run.tailSwing * fastMath::radiansToDegrees,
+                        run.tailSpeed, run.meanControlNs(), static_cast<long long>(run.maxControlNs), ok ? "ok" : "FAILED");
+            passed &= ok;
+        }
+        return passed;
+    }
+
+    struct Check {
+        const char* name;
+        bool (*run)();
+    };
+
+    constexpr Check checks[] = {
+            {"detent_capture", detentCapture},
+            {"wall_stiffness", wallStiffness},
+            {"no_limit_cycle", noLimitCycle},
+    };
+} // namespace
+
+int main(const int argc, char** argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: %s <check>\n", argv[0]);
+        return 2;
+    }
+
+    for (const auto& [name, run] : checks) {
+        if (std::strcmp(argv[1], name) == 0) {
+            return run() ? 0 : 1;
+        }
+    }
+    std::fprintf(stderr, "Unknown check %s\n", argv[1]);
+    return 2;
+}
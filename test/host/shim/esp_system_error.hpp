@@ -0,0 +1,17 @@
+#ifndef FIRMWARE_TEST_HOST_SHIM_ESP_SYSTEM_ERROR_HPP
+#define FIRMWARE_TEST_HOST_SHIM_ESP_SYSTEM_ERROR_HPP
+
+#include <system_error>
+
+// Host stand-in for the SDK header, the error codes the haptics code returns, values from esp_err.h
+using esp_err_t = int;
+
+#define ESP_OK                0
+#define ESP_ERR_INVALID_ARG   0x102
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+namespace std {
+    inline error_code make_error_code(const esp_err_t err) { return {err, generic_category()}; }
+} // namespace std
+
+#endif // FIRMWARE_TEST_HOST_SHIM_ESP_SYSTEM_ERROR_HPP